@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size, used;
+	alignas(max_align_t) unsigned char data[];
+};
+
+void
+arena_init(struct arena *arena)
+{
+	arena->blocks = NULL;
+}
+
+void
+arena_finish(struct arena *arena)
+{
+	struct arena_block *block = arena->blocks;
+	while (block) {
+		struct arena_block *next = block->next;
+		free(block);
+		block = next;
+	}
+	arena->blocks = NULL;
+}
+
+static void *
+alloc(struct arena *arena, size_t size, size_t align)
+{
+	struct arena_block *block = arena->blocks;
+	if (block) {
+		size_t offset = (block->used + align - 1) & ~(align - 1);
+		if (offset + size <= block->size) {
+			block->used = offset + size;
+			return block->data + offset;
+		}
+	}
+
+	/*
+	 * Anything too large for a block of its own size gets one, behind the
+	 * current block so that the space left in that is not lost
+	 */
+	size_t block_size = size > ARENA_BLOCK_SIZE / 4
+		? size : ARENA_BLOCK_SIZE;
+	struct arena_block *fresh = malloc(sizeof(*fresh) + block_size);
+	fresh->size = block_size;
+	fresh->used = size;
+	if (block && block_size != ARENA_BLOCK_SIZE) {
+		fresh->next = block->next;
+		block->next = fresh;
+	} else {
+		fresh->next = block;
+		arena->blocks = fresh;
+	}
+	return fresh->data;
+}
+
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+	void *p = alloc(arena, size, alignof(max_align_t));
+	memset(p, 0, size);
+	return p;
+}
+
+char *
+arena_strdup(struct arena *arena, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *copy = alloc(arena, len, 1);
+	memcpy(copy, s, len);
+	return copy;
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+/*
+ * Bump allocator for things built up piece by piece and thrown away
+ * together, such as the regions of a config. Memory comes from a few large
+ * blocks and is only given back when the whole arena is finished, so many
+ * small allocations neither cost a malloc() each nor fragment the heap.
+ */
+struct arena {
+	struct arena_block *blocks;
+};
+
+void arena_init(struct arena *arena);
+void arena_finish(struct arena *arena);
+
+/* Zeroed memory, aligned for any type */
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strdup(struct arena *arena, const char *s);
+
+#endif /* ARENA_H */
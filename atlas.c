@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Glyph atlas for the small set of labels drawn by the editor.
+ *
+ * Each printable ASCII character is rasterized by pango into an A8 surface
+ * the first time it is needed. Strings are then composited from the atlas
+ * with a plain blitting loop instead of a pango layout per draw command.
+ * Kerning and shaping are lost, which is fine for region names and numbers.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <cairo.h>
+#include <pango/pangocairo.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "atlas.h"
+
+#define ATLAS_FIRST ' '
+#define ATLAS_LAST '~'
+#define ATLAS_COLUMNS 16
+#define ATLAS_ROWS ((ATLAS_LAST - ATLAS_FIRST + ATLAS_COLUMNS) / ATLAS_COLUMNS)
+
+struct glyph {
+	bool cached;
+	int advance;
+	/* Ink box relative to the pen position at the top of the line */
+	int x, y, width, height;
+	/* Top-left corner of the ink box in the atlas */
+	int atlas_x, atlas_y;
+};
+
+struct atlas {
+	PangoFontDescription *font_desc;
+	cairo_surface_t *surface;
+	cairo_t *cairo;
+	int cell_width, cell_height;
+	/* Offset of the pen position within a cell */
+	int pen_x, pen_y;
+	struct glyph glyphs[ATLAS_LAST - ATLAS_FIRST + 1];
+};
+
+struct atlas *
+atlas_create(const PangoFontDescription *font_desc)
+{
+	struct atlas *atlas = calloc(1, sizeof(struct atlas));
+	atlas->font_desc = pango_font_description_copy(font_desc);
+
+	/* A context in an error state has no font options to measure with */
+	cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_A8,
+		1, 1);
+	cairo_t *cairo = cairo_create(scratch);
+	PangoContext *pango = pango_cairo_create_context(cairo);
+	PangoFontMetrics *metrics =
+		pango_context_get_metrics(pango, font_desc, NULL);
+	int height = pango_font_metrics_get_height(metrics) / PANGO_SCALE;
+	pango_font_metrics_unref(metrics);
+	g_object_unref(pango);
+	cairo_destroy(cairo);
+	cairo_surface_destroy(scratch);
+
+	/* Leave room for ink that overhangs the logical rectangle */
+	atlas->pen_x = height / 2;
+	atlas->pen_y = height / 2;
+	atlas->cell_width = 3 * height;
+	atlas->cell_height = 2 * height;
+
+	atlas->surface = cairo_image_surface_create(CAIRO_FORMAT_A8,
+		ATLAS_COLUMNS * atlas->cell_width,
+		ATLAS_ROWS * atlas->cell_height);
+	atlas->cairo = cairo_create(atlas->surface);
+	cairo_set_source_rgba(atlas->cairo, 0.0, 0.0, 0.0, 1.0);
+	return atlas;
+}
+
+void
+atlas_destroy(struct atlas *atlas)
+{
+	if (!atlas) {
+		return;
+	}
+	cairo_destroy(atlas->cairo);
+	cairo_surface_destroy(atlas->surface);
+	pango_font_description_free(atlas->font_desc);
+	free(atlas);
+}
+
+static int
+clamp(int value, int low, int high)
+{
+	return value < low ? low : value > high ? high : value;
+}
+
+static struct glyph *
+get_glyph(struct atlas *atlas, unsigned char ch)
+{
+	if (ch < ATLAS_FIRST || ch > ATLAS_LAST) {
+		return NULL;
+	}
+	int i = ch - ATLAS_FIRST;
+	struct glyph *glyph = &atlas->glyphs[i];
+	if (glyph->cached) {
+		return glyph;
+	}
+
+	int cell_x = (i % ATLAS_COLUMNS) * atlas->cell_width;
+	int cell_y = (i / ATLAS_COLUMNS) * atlas->cell_height;
+
+	char str[2] = { ch, '\0' };
+	PangoLayout *layout = pango_cairo_create_layout(atlas->cairo);
+	pango_layout_set_font_description(layout, atlas->font_desc);
+	pango_layout_set_text(layout, str, -1);
+	PangoRectangle ink, logical;
+	pango_layout_get_pixel_extents(layout, &ink, &logical);
+	cairo_move_to(atlas->cairo, cell_x + atlas->pen_x, cell_y + atlas->pen_y);
+	pango_cairo_show_layout(atlas->cairo, layout);
+	g_object_unref(layout);
+	cairo_surface_flush(atlas->surface);
+
+	/* Clip the ink box to the cell so neighbours never bleed in */
+	int x1 = clamp(ink.x, -atlas->pen_x, atlas->cell_width - atlas->pen_x);
+	int y1 = clamp(ink.y, -atlas->pen_y, atlas->cell_height - atlas->pen_y);
+	int x2 = clamp(ink.x + ink.width, x1, atlas->cell_width - atlas->pen_x);
+	int y2 = clamp(ink.y + ink.height, y1, atlas->cell_height - atlas->pen_y);
+
+	glyph->advance = logical.width;
+	glyph->x = x1;
+	glyph->y = y1;
+	glyph->width = x2 - x1;
+	glyph->height = y2 - y1;
+	glyph->atlas_x = cell_x + atlas->pen_x + x1;
+	glyph->atlas_y = cell_y + atlas->pen_y + y1;
+	glyph->cached = true;
+	return glyph;
+}
+
+int
+atlas_text_width(struct atlas *atlas, const char *str, int len)
+{
+	int width = 0;
+	for (int i = 0; len < 0 ? str[i] : i < len; i++) {
+		struct glyph *glyph = get_glyph(atlas, str[i]);
+		if (!glyph) {
+			return -1;
+		}
+		width += glyph->advance;
+	}
+	return width;
+}
+
+/* Exact x / 255 for x in [0, 255 * 255] */
+static inline uint32_t
+div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/* Composite @color through an A8 mask onto premultiplied ARGB32 with OVER */
+static void
+blit_glyph(const unsigned char *mask, int mask_stride, uint32_t *dst,
+		int dst_stride, int width, int height, mu_Color color)
+{
+	for (int y = 0; y < height; y++) {
+		const unsigned char *m = mask + y * mask_stride;
+		uint32_t *d = dst + y * dst_stride;
+		for (int x = 0; x < width; x++) {
+			uint32_t a = div255(m[x] * color.a);
+			if (!a) {
+				continue;
+			}
+			uint32_t inv = 255 - a;
+			uint32_t p = d[x];
+			uint32_t pa = div255((p >> 24) * inv) + a;
+			uint32_t pr = div255(((p >> 16) & 0xff) * inv) + div255(color.r * a);
+			uint32_t pg = div255(((p >> 8) & 0xff) * inv) + div255(color.g * a);
+			uint32_t pb = div255((p & 0xff) * inv) + div255(color.b * a);
+			d[x] = pa << 24 | pr << 16 | pg << 8 | pb;
+		}
+	}
+}
+
+bool
+atlas_draw_text(struct atlas *atlas, cairo_surface_t *target, mu_Vec2 pos,
+		mu_Color color, const char *str, const struct box *clip)
+{
+	/* Rasterize any missing glyphs first so we never draw half a string */
+	if (atlas_text_width(atlas, str, -1) < 0) {
+		return false;
+	}
+	if (!color.a) {
+		return true;
+	}
+
+	int dst_stride = cairo_image_surface_get_stride(target) / 4;
+	uint32_t *dst = (uint32_t *)cairo_image_surface_get_data(target);
+	int mask_stride = cairo_image_surface_get_stride(atlas->surface);
+	const unsigned char *mask = cairo_image_surface_get_data(atlas->surface);
+
+	/* Map user coordinates to pixels, e.g. for tiles of a larger buffer */
+	double dx, dy;
+	cairo_surface_get_device_offset(target, &dx, &dy);
+	int offset_x = (int)dx;
+	int offset_y = (int)dy;
+
+	/* Pixels that may be touched: @clip, within the target */
+	int x1 = clip->x + offset_x;
+	int y1 = clip->y + offset_y;
+	int x2 = x1 + clip->width;
+	int y2 = y1 + clip->height;
+	x1 = x1 < 0 ? 0 : x1;
+	y1 = y1 < 0 ? 0 : y1;
+	if (x2 > cairo_image_surface_get_width(target)) {
+		x2 = cairo_image_surface_get_width(target);
+	}
+	if (y2 > cairo_image_surface_get_height(target)) {
+		y2 = cairo_image_surface_get_height(target);
+	}
+
+	cairo_surface_flush(target);
+
+	struct box drawn = { 0 };
+	int pen = pos.x + offset_x;
+	for (const char *p = str; *p; p++) {
+		struct glyph *glyph = get_glyph(atlas, *p);
+		int x = pen + glyph->x;
+		int y = pos.y + offset_y + glyph->y;
+		pen += glyph->advance;
+
+		int sx = x < x1 ? x1 - x : 0;
+		int sy = y < y1 ? y1 - y : 0;
+		int w = glyph->width - sx;
+		int h = glyph->height - sy;
+		if (x + sx + w > x2) {
+			w = x2 - x - sx;
+		}
+		if (y + sy + h > y2) {
+			h = y2 - y - sy;
+		}
+		if (w <= 0 || h <= 0) {
+			continue;
+		}
+
+		blit_glyph(mask + (glyph->atlas_y + sy) * mask_stride
+				+ glyph->atlas_x + sx, mask_stride,
+			dst + (y + sy) * dst_stride + x + sx, dst_stride,
+			w, h, color);
+		struct box box = { x + sx, y + sy, w, h };
+		box_union(&drawn, &box);
+	}
+
+	if (!box_empty(&drawn)) {
+		cairo_surface_mark_dirty_rectangle(target, drawn.x - offset_x,
+			drawn.y - offset_y, drawn.width, drawn.height);
+	}
+	return true;
+}
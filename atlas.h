@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef ATLAS_H
+#define ATLAS_H
+#include <pango/pangocairo.h>
+#include <stdbool.h>
+#include "microui.h"
+#include "util.h"
+
+struct atlas;
+
+struct atlas *atlas_create(const PangoFontDescription *font_desc);
+void atlas_destroy(struct atlas *atlas);
+
+/*
+ * Return the width of the first @len bytes of @str (all of it if @len is -1),
+ * or -1 if it contains characters that are not held in the atlas
+ */
+int atlas_text_width(struct atlas *atlas, const char *str, int len);
+
+/*
+ * Composite @str onto the ARGB32 image surface @target with its top-left
+ * corner at @pos, touching no pixels outside @clip. Returns false without
+ * drawing anything if the string cannot be drawn from the atlas, in which case
+ * the caller should fall back to pango.
+ */
+bool atlas_draw_text(struct atlas *atlas, cairo_surface_t *target,
+	mu_Vec2 pos, mu_Color color, const char *str, const struct box *clip);
+
+#endif /* ATLAS_H */
@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "batch.h"
+#include "preset.h"
+#include "region.h"
+#include "settings.h"
+#include "spatial.h"
+#include "util.h"
+
+static bool
+rename_region(struct region_table *regions, const char *filename,
+		const char *rename)
+{
+	const char *equals = strchr(rename, '=');
+	int len = equals - rename;
+
+	/* Renames are few, so a scan saves copying out the old name */
+	int id = -1;
+	region_for_each(regions, i) {
+		const char *name = regions->name[i];
+		if (!strncmp(name, rename, len) && !name[len]) {
+			id = i;
+			break;
+		}
+	}
+	if (id < 0) {
+		LOG(LOG_ERROR, "%s: no region called '%.*s'", filename, len,
+			rename);
+		return false;
+	}
+	if (!settings_region_rename(id, equals + 1)) {
+		LOG(LOG_ERROR, "%s: there is a region called '%s' already",
+			filename, equals + 1);
+		return false;
+	}
+	return true;
+}
+
+struct overlap {
+	struct region_table *regions;
+	const char *filename;
+	int region;
+	bool found;
+};
+
+/*
+ * Overlaps thinner than this come from rounding, for example where regions
+ * given as thirds of the output meet
+ */
+#define OVERLAP_TOLERANCE 0.001
+
+static void
+report_overlap(int other, void *data)
+{
+	struct overlap *overlap = data;
+	/* Each pair is seen from both sides, so report it once */
+	if (other < overlap->region) {
+		return;
+	}
+	struct dbox a = region_box(overlap->regions, overlap->region);
+	struct dbox b = region_box(overlap->regions, other);
+	double width = fmin(a.x + a.width, b.x + b.width) - fmax(a.x, b.x);
+	double height = fmin(a.y + a.height, b.y + b.height) - fmax(a.y, b.y);
+	if (width < OVERLAP_TOLERANCE || height < OVERLAP_TOLERANCE) {
+		return;
+	}
+	LOG(LOG_ERROR, "%s: regions '%s' and '%s' overlap", overlap->filename,
+		overlap->regions->name[overlap->region],
+		overlap->regions->name[other]);
+	overlap->found = true;
+}
+
+static bool
+validate(struct region_table *regions, const char *filename, int width,
+		int height)
+{
+	bool ok = true;
+	struct spatial_index *index = spatial_index_create(regions, width,
+		height);
+	region_for_each(regions, id) {
+		spatial_index_insert(index, id);
+	}
+
+	region_for_each(regions, id) {
+		struct dbox box = region_box(regions, id);
+		if (box.width <= 0 || box.height <= 0) {
+			LOG(LOG_ERROR, "%s: region '%s' is empty", filename,
+				regions->name[id]);
+			ok = false;
+		} else if (box.x < 0 || box.y < 0 || box.x + box.width > width
+				|| box.y + box.height > height) {
+			LOG(LOG_ERROR, "%s: region '%s' is outside the output",
+				filename, regions->name[id]);
+			ok = false;
+		}
+
+		struct overlap overlap = {
+			.regions = regions,
+			.filename = filename,
+			.region = id,
+		};
+		spatial_index_overlaps(index, id, report_overlap, &overlap);
+		ok = ok && !overlap.found;
+	}
+	spatial_index_destroy(index);
+	return ok;
+}
+
+static int
+process_file(const struct batch *batch, const char *filename)
+{
+	struct config config = {
+		.fractional_percent = batch->fractional_percent,
+	};
+	if (strlen(filename) >= sizeof(config.filename)) {
+		LOG(LOG_ERROR, "%s: path too long", filename);
+		return EXIT_FAILURE;
+	}
+	strcpy(config.filename, filename);
+
+	struct region_table *regions = settings_init(filename);
+	convert_regions_from_percentage_to_pixels(batch->width, batch->height);
+
+	bool ok = true;
+	bool modified = batch->preset || batch->scale != 1
+		|| batch->nr_renames;
+	if (batch->preset && !preset_apply(batch->presets, batch->preset,
+			regions, batch->width, batch->height)) {
+		LOG(LOG_ERROR, "%s: no regions to lay out", filename);
+		ok = false;
+	}
+	if (ok && batch->scale != 1) {
+		settings_scale(batch->scale, batch->width, batch->height);
+	}
+	for (int i = 0; ok && i < batch->nr_renames; i++) {
+		ok = rename_region(regions, filename, batch->renames[i]);
+	}
+	if (ok && batch->validate) {
+		ok = validate(regions, filename, batch->width, batch->height);
+	}
+	if (ok && modified) {
+		ok = settings_save(&config, batch->width, batch->height) >= 0;
+	}
+	settings_finish();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Wait for a worker, returning whether it succeeded */
+static bool
+reap(pid_t *pids, char *const *files, int nr_files)
+{
+	int status;
+	pid_t pid = wait(&status);
+	if (pid < 0) {
+		return false;
+	}
+	if (WIFEXITED(status)) {
+		return WEXITSTATUS(status) == EXIT_SUCCESS;
+	}
+	for (int i = 0; i < nr_files; i++) {
+		if (pids[i] == pid) {
+			LOG(LOG_ERROR, "%s: worker killed by signal %d",
+				files[i], WTERMSIG(status));
+		}
+	}
+	return false;
+}
+
+/*
+ * settings.c keeps one document at a time in globals, and libxml2 keeps
+ * state of its own, so rather than threads, each file gets a process
+ */
+int
+batch_run(const struct batch *batch, char *const *files, int nr_files)
+{
+	for (int i = 0; i < batch->nr_renames; i++) {
+		const char *equals = strchr(batch->renames[i], '=');
+		if (!equals || equals == batch->renames[i] || !equals[1]) {
+			LOG(LOG_ERROR, "expected <old>=<new>, not '%s'",
+				batch->renames[i]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (batch->preset && !preset_exists(batch->presets, batch->preset)) {
+		LOG(LOG_ERROR, "unknown preset '%s'", batch->preset);
+		return EXIT_FAILURE;
+	}
+
+	int jobs = batch->jobs;
+	if (jobs <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? cpus : 1;
+	}
+
+	pid_t *pids = calloc(nr_files, sizeof(pid_t));
+	int running = 0;
+	bool ok = true;
+
+	/* Or the children would print what is buffered again */
+	fflush(NULL);
+	for (int i = 0; i < nr_files; i++) {
+		if (running == jobs) {
+			ok = reap(pids, files, nr_files) && ok;
+			running--;
+		}
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			LOG_ERRNO(LOG_ERROR, "%s: fork failed", files[i]);
+			ok = false;
+		} else if (!pids[i]) {
+			int status = process_file(batch, files[i]);
+			fflush(NULL);
+			_exit(status);
+		} else {
+			running++;
+		}
+	}
+	while (running--) {
+		ok = reap(pids, files, nr_files) && ok;
+	}
+	free(pids);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef BATCH_H
+#define BATCH_H
+#include <stdbool.h>
+
+struct preset_library;
+
+/*
+ * Edit config files without connecting to a compositor. Each file is read,
+ * put through the steps below in the order they are listed, and written
+ * back if any of them changed it. Files are worked on in processes of their
+ * own, up to @jobs at a time.
+ */
+struct batch {
+	/* Worker processes, or 0 for one per online CPU */
+	int jobs;
+	/* Output size that percentages are relative to */
+	int width, height;
+	/* Save edited geometry with up to four decimals rather than whole percent */
+	bool fractional_percent;
+
+	/* Lay out the regions in this preset from @presets */
+	const char *preset;
+	struct preset_library *presets;
+	/* Scale all geometry by this factor, unless it is 1 */
+	double scale;
+	/* Renames, each given as "<old>=<new>" */
+	char **renames;
+	int nr_renames;
+	/* Fail files with overlapping regions or regions outside the output */
+	bool validate;
+};
+
+/* Returns the exit status, which is a failure if any file failed */
+int batch_run(const struct batch *batch, char *const *files, int nr_files);
+
+#endif /* BATCH_H */
@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdlib.h>
+#include "constraint.h"
+#include "region.h"
+
+/* Edges closer than this are taken to be on the same line */
+#define EPSILON 0.5
+
+enum axis {
+	AXIS_X,
+	AXIS_Y,
+};
+
+enum side {
+	SIDE_START,
+	SIDE_END,
+};
+
+struct edge {
+	int region;
+	enum side side;
+	double value;
+	/* Extent along the line */
+	double from, to;
+	bool visited;
+};
+
+struct member {
+	int region;
+	enum side side;
+	/* Distance from the dragged edge */
+	double offset;
+};
+
+struct group {
+	struct member *members;
+	int nr_members, capacity;
+};
+
+struct constraint_solver {
+	double gap, min_size;
+	region_changed_fn changed;
+	void *data;
+
+	struct region_table *table;
+	/* The region being resized, or -1 */
+	int region;
+
+	/* Edges of every region sorted by value, per axis */
+	struct edge *edges[2];
+	int nr_edges, capacity;
+
+	/* Edges tied to each edge of the region being resized */
+	struct group groups[2][2];
+};
+
+struct constraint_solver *
+constraint_solver_create(double gap, double min_size, region_changed_fn changed,
+		void *data)
+{
+	struct constraint_solver *solver =
+		calloc(1, sizeof(struct constraint_solver));
+	solver->gap = gap;
+	solver->min_size = min_size;
+	solver->changed = changed;
+	solver->data = data;
+	solver->region = -1;
+	return solver;
+}
+
+void
+constraint_solver_destroy(struct constraint_solver *solver)
+{
+	if (!solver) {
+		return;
+	}
+	free(solver->edges[AXIS_X]);
+	free(solver->edges[AXIS_Y]);
+	for (int axis = 0; axis < 2; axis++) {
+		for (int side = 0; side < 2; side++) {
+			free(solver->groups[axis][side].members);
+		}
+	}
+	free(solver);
+}
+
+static double
+edge_value(const struct dbox *box, enum axis axis, enum side side)
+{
+	if (axis == AXIS_X) {
+		return side == SIDE_START ? box->x : box->x + box->width;
+	}
+	return side == SIDE_START ? box->y : box->y + box->height;
+}
+
+static void
+set_edge(struct dbox *box, enum axis axis, enum side side, double value)
+{
+	double *start = axis == AXIS_X ? &box->x : &box->y;
+	double *size = axis == AXIS_X ? &box->width : &box->height;
+	if (side == SIDE_START) {
+		*size += *start - value;
+		*start = value;
+	} else {
+		*size = value - *start;
+	}
+}
+
+static int
+compare_edge(const void *a, const void *b)
+{
+	double x = ((const struct edge *)a)->value;
+	double y = ((const struct edge *)b)->value;
+	return (x > y) - (x < y);
+}
+
+static void
+add_edges(struct edge *edges, struct region_table *table, int region,
+		enum axis axis)
+{
+	struct dbox r = region_box(table, region);
+	const struct dbox *box = &r;
+	double from = axis == AXIS_X ? box->y : box->x;
+	double to = from + (axis == AXIS_X ? box->height : box->width);
+	for (int side = 0; side < 2; side++) {
+		edges[side] = (struct edge){
+			.region = region,
+			.side = side,
+			.value = edge_value(box, axis, side),
+			.from = from,
+			.to = to,
+		};
+	}
+}
+
+/* Index of the first edge at or after @value */
+static int
+lower_bound(struct edge *edges, int nr, double value)
+{
+	int low = 0, high = nr;
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+		if (edges[mid].value < value) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static void
+group_add(struct group *group, struct edge *edge, double offset)
+{
+	if (group->nr_members == group->capacity) {
+		group->capacity = group->capacity ? group->capacity * 2 : 16;
+		group->members = realloc(group->members,
+			group->capacity * sizeof(struct member));
+	}
+	group->members[group->nr_members++] = (struct member){
+		.region = edge->region,
+		.side = edge->side,
+		.offset = offset,
+	};
+}
+
+/*
+ * Is @edge tied to a dragged edge at @value on @side? Edges on the same side
+ * share its line, those on the other side face it across the gap.
+ */
+static bool
+is_tied(struct edge *edge, double value, enum side side, double gap)
+{
+	double line = value;
+	if (edge->side != side) {
+		line += side == SIDE_END ? gap : -gap;
+	}
+	return fabs(edge->value - line) < EPSILON;
+}
+
+/* Do @a and @b overlap along their line, or stop no further than @gap apart? */
+static bool
+extents_touch(struct edge *a, struct edge *b, double gap)
+{
+	return a->from <= b->to + gap + EPSILON
+		&& b->from <= a->to + gap + EPSILON;
+}
+
+/*
+ * Collect the edges tied to one edge of the region being resized. Starting
+ * from the dragged edge, candidates on its line (or across the gap) join the
+ * group if their extent touches that of an edge already in it, so that a
+ * border carries on across the gaps between the regions along it.
+ */
+static void
+build_group(struct constraint_solver *solver, enum axis axis, enum side side)
+{
+	struct group *group = &solver->groups[axis][side];
+	struct edge *edges = solver->edges[axis];
+	int nr = solver->nr_edges;
+	struct dbox box = region_box(solver->table, solver->region);
+	double value = edge_value(&box, axis, side);
+	double reach = solver->gap + EPSILON;
+
+	group->nr_members = 0;
+	int first = lower_bound(edges, nr, value - reach);
+	int last = lower_bound(edges, nr, value + reach);
+	int seed = -1;
+	for (int i = first; i < last; i++) {
+		/* Edges that are not tied are never visited */
+		edges[i].visited = !is_tied(&edges[i], value, side, solver->gap);
+		if (edges[i].region == solver->region && edges[i].side == side) {
+			seed = i;
+		}
+	}
+	if (seed < 0) {
+		return;
+	}
+
+	edges[seed].visited = true;
+	group_add(group, &edges[seed], 0);
+	int *queue = malloc((last - first) * sizeof(int));
+	int head = 0, tail = 0;
+	queue[tail++] = seed;
+	while (head < tail) {
+		struct edge *edge = &edges[queue[head++]];
+		for (int i = first; i < last; i++) {
+			if (edges[i].visited || !extents_touch(edge, &edges[i],
+					solver->gap)) {
+				continue;
+			}
+			edges[i].visited = true;
+			group_add(group, &edges[i], edges[i].value - value);
+			queue[tail++] = i;
+		}
+	}
+	free(queue);
+}
+
+void
+constraint_begin(struct constraint_solver *solver, struct region_table *table,
+		int region)
+{
+	int nr = 0;
+	region_for_each(table, id) {
+		nr += 2;
+	}
+	if (nr > solver->capacity) {
+		solver->edges[AXIS_X] = realloc(solver->edges[AXIS_X],
+			nr * sizeof(struct edge));
+		solver->edges[AXIS_Y] = realloc(solver->edges[AXIS_Y],
+			nr * sizeof(struct edge));
+		solver->capacity = nr;
+	}
+	solver->nr_edges = nr;
+	solver->table = table;
+	solver->region = region;
+
+	for (int axis = 0; axis < 2; axis++) {
+		struct edge *edges = solver->edges[axis];
+		int i = 0;
+		region_for_each(table, id) {
+			add_edges(&edges[i], table, id, axis);
+			i += 2;
+		}
+		qsort(edges, nr, sizeof(struct edge), compare_edge);
+		build_group(solver, axis, SIDE_START);
+		build_group(solver, axis, SIDE_END);
+	}
+}
+
+void
+constraint_end(struct constraint_solver *solver)
+{
+	solver->region = -1;
+}
+
+int
+constraint_region(struct constraint_solver *solver)
+{
+	return solver->region;
+}
+
+/* Clamp @value so that no region in @group ends up below the min size */
+static double
+clamp_to_group(struct constraint_solver *solver, struct group *group,
+		enum axis axis, double value)
+{
+	double low = -INFINITY, high = INFINITY;
+	for (int i = 0; i < group->nr_members; i++) {
+		struct member *m = &group->members[i];
+		struct dbox box = region_box(solver->table, m->region);
+		double opposite = edge_value(&box, axis, !m->side);
+		if (m->side == SIDE_END) {
+			low = fmax(low, opposite + solver->min_size - m->offset);
+		} else {
+			high = fmin(high, opposite - solver->min_size - m->offset);
+		}
+	}
+	if (low > high) {
+		/* Already too small somewhere, so stay put */
+		struct dbox box = region_box(solver->table, solver->region);
+		return edge_value(&box, axis, group->members[0].side);
+	}
+	return fmax(low, fmin(high, value));
+}
+
+static void
+move_group(struct constraint_solver *solver, struct group *group,
+		enum axis axis, double value)
+{
+	for (int i = 0; i < group->nr_members; i++) {
+		struct member *m = &group->members[i];
+		struct dbox box = region_box(solver->table, m->region);
+		set_edge(&box, axis, m->side, value + m->offset);
+		region_set_box(solver->table, m->region, &box);
+		if (m->region != solver->region && solver->changed) {
+			solver->changed(m->region, solver->data);
+		}
+	}
+}
+
+void
+constraint_resize(struct constraint_solver *solver, const struct dbox *box)
+{
+	int region = solver->region;
+	if (region < 0) {
+		return;
+	}
+	for (int axis = 0; axis < 2; axis++) {
+		for (int side = 0; side < 2; side++) {
+			struct group *group = &solver->groups[axis][side];
+			double value = edge_value(box, axis, side);
+			struct dbox current = region_box(solver->table, region);
+			if (!group->nr_members || value
+					== edge_value(&current, axis, side)) {
+				continue;
+			}
+			value = clamp_to_group(solver, group, axis, value);
+			move_group(solver, group, axis, value);
+		}
+	}
+
+	/*
+	 * The caller may already have moved its own copy of @region to @box,
+	 * so report it even if the constraints held it where it was
+	 */
+	if (solver->changed) {
+		solver->changed(region, solver->data);
+	}
+}
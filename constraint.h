@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef CONSTRAINT_H
+#define CONSTRAINT_H
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Keeps region edges together while one region is resized. Edges that touch
+ * the resized region's edge, or lie exactly @gap pixels across from it, are
+ * constrained to move with it, and so on along the border they form. Every
+ * region keeps at least @min_size pixels in both directions.
+ *
+ * These constraints form one group of edges tied by fixed offsets per
+ * dragged edge, with bounds from the min sizes, so solving each pointer
+ * frame comes down to clamping the requested position. The groups are
+ * found once, when the resize starts.
+ */
+struct constraint_solver;
+struct region_table;
+
+struct constraint_solver *constraint_solver_create(double gap,
+	double min_size, region_changed_fn changed, void *data);
+void constraint_solver_destroy(struct constraint_solver *solver);
+
+/* Start resizing @region, collecting the edges that move with its own */
+void constraint_begin(struct constraint_solver *solver,
+	struct region_table *table, int region);
+void constraint_end(struct constraint_solver *solver);
+
+/* The region being resized, or -1 */
+int constraint_region(struct constraint_solver *solver);
+
+/*
+ * Move the edges of the region being resized as near to those of @box as the
+ * constraints allow, along with the edges tied to them
+ */
+void constraint_resize(struct constraint_solver *solver,
+	const struct dbox *box);
+
+#endif /* CONSTRAINT_H */
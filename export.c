@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* memfd_create() and file sealing are Linux extensions */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "export.h"
+#include "region.h"
+#include "util.h"
+
+static size_t
+export_size(uint32_t capacity)
+{
+	return sizeof(struct export_header)
+		+ capacity * sizeof(struct export_region);
+}
+
+/* Times a reader retries before giving up on a writer that never finishes */
+#define EXPORT_READ_RETRIES 1000
+
+struct exporter {
+	int fd;
+	uint32_t capacity;
+	struct export_header *header;
+	struct export_region *regions;
+	/* The next table, built here and only published if it differs */
+	struct export_region *scratch;
+};
+
+/* Create a sealed memfd with room for @capacity regions, and map it */
+static bool
+export_map(struct exporter *exporter, uint32_t capacity)
+{
+	size_t size = export_size(capacity);
+	int fd = memfd_create("labwc-regions", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		LOG_ERRNO(LOG_ERROR, "cannot create memfd");
+		return false;
+	}
+	if (ftruncate(fd, size)) {
+		LOG_ERRNO(LOG_ERROR, "cannot size memfd");
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		0);
+	if (data == MAP_FAILED) {
+		LOG_ERRNO(LOG_ERROR, "cannot map memfd");
+		close(fd);
+		return false;
+	}
+
+	/*
+	 * Readers can then map it without fear of SIGBUS, and only through
+	 * the mapping above can it be written
+	 */
+	int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+	seals |= F_SEAL_FUTURE_WRITE;
+#endif
+	if (fcntl(fd, F_ADD_SEALS, seals)) {
+		LOG_ERRNO(LOG_ERROR, "cannot seal memfd");
+	}
+
+	exporter->fd = fd;
+	exporter->capacity = capacity;
+	exporter->header = data;
+	exporter->regions = (struct export_region *)(exporter->header + 1);
+
+	struct export_header *header = exporter->header;
+	memcpy(header->magic, EXPORT_MAGIC, sizeof(header->magic));
+	header->version = EXPORT_VERSION;
+	header->header_size = sizeof(struct export_header);
+	header->region_size = sizeof(struct export_region);
+	header->capacity = capacity;
+	return true;
+}
+
+static void
+export_unmap(struct exporter *exporter)
+{
+	munmap(exporter->header, export_size(exporter->capacity));
+	close(exporter->fd);
+}
+
+struct exporter *
+exporter_create(void)
+{
+	struct exporter *exporter = calloc(1, sizeof(*exporter));
+	if (!export_map(exporter, EXPORT_CAPACITY)) {
+		free(exporter);
+		return NULL;
+	}
+	exporter->scratch = calloc(EXPORT_CAPACITY, sizeof(*exporter->scratch));
+	return exporter;
+}
+
+void
+exporter_destroy(struct exporter *exporter)
+{
+	if (!exporter) {
+		return;
+	}
+	export_unmap(exporter);
+	free(exporter->scratch);
+	free(exporter);
+}
+
+int
+exporter_fd(struct exporter *exporter)
+{
+	return exporter->fd;
+}
+
+/* Begin and end an update of @header, see @sequence */
+static uint32_t
+write_begin(struct export_header *header)
+{
+	uint32_t sequence = atomic_load_explicit(&header->sequence,
+		memory_order_relaxed);
+	atomic_store_explicit(&header->sequence, sequence + 1,
+		memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	return sequence;
+}
+
+static void
+write_end(struct export_header *header, uint32_t sequence)
+{
+	atomic_store_explicit(&header->sequence, sequence + 2,
+		memory_order_release);
+}
+
+/*
+ * Move to a memfd with room for @nr regions. The old one is flagged as
+ * replaced, so that readers holding it know to ask for the new one.
+ */
+static bool
+export_grow(struct exporter *exporter, uint32_t nr)
+{
+	uint32_t capacity = exporter->capacity;
+	while (capacity < nr) {
+		capacity *= 2;
+	}
+	struct export_region *scratch = realloc(exporter->scratch,
+		capacity * sizeof(*scratch));
+	if (!scratch) {
+		return false;
+	}
+	exporter->scratch = scratch;
+
+	struct exporter old = *exporter;
+	if (!export_map(exporter, capacity)) {
+		return false;
+	}
+	uint32_t sequence = write_begin(old.header);
+	old.header->flags |= EXPORT_REPLACED;
+	write_end(old.header, sequence);
+	export_unmap(&old);
+	return true;
+}
+
+void
+exporter_publish(struct exporter *exporter, const struct region_table *table,
+		int width, int height)
+{
+	uint32_t live = 0;
+	region_for_each(table, id) {
+		live++;
+	}
+	if (live > exporter->capacity && !export_grow(exporter, live)) {
+		LOG(LOG_ERROR, "cannot export more than %u of %u regions",
+			exporter->capacity, live);
+	}
+
+	uint32_t nr = 0;
+	region_for_each(table, id) {
+		if (nr == exporter->capacity) {
+			break;
+		}
+		struct export_region *region = &exporter->scratch[nr++];
+		memset(region, 0, sizeof(*region));
+		strncpy(region->name, table->name[id], sizeof(region->name) - 1);
+		region->x = table->x[id];
+		region->y = table->y[id];
+		region->width = table->width[id];
+		region->height = table->height[id];
+		region->fx = table->fx[id];
+		region->fy = table->fy[id];
+		region->fwidth = table->fwidth[id];
+		region->fheight = table->fheight[id];
+		region->flags = table->flags[id];
+	}
+	uint32_t flags = nr < live ? EXPORT_TRUNCATED : 0;
+
+	/*
+	 * This is called for every frame, so leave the sequence alone unless
+	 * something changed, or readers would pick up the same table again
+	 */
+	struct export_header *header = exporter->header;
+	size_t size = nr * sizeof(struct export_region);
+	if (header->nr_regions == nr && header->output_width == (uint32_t)width
+			&& header->output_height == (uint32_t)height
+			&& header->flags == flags
+			&& !memcmp(exporter->regions, exporter->scratch, size)) {
+		return;
+	}
+
+	uint32_t sequence = write_begin(header);
+	memcpy(exporter->regions, exporter->scratch, size);
+	header->nr_regions = nr;
+	header->output_width = width;
+	header->output_height = height;
+	header->flags = flags;
+	write_end(header, sequence);
+}
+
+static bool
+check_format(const struct export_header *header, size_t size)
+{
+	if (size < sizeof(*header)
+			|| memcmp(header->magic, EXPORT_MAGIC, sizeof(header->magic))
+			|| header->version != EXPORT_VERSION
+			|| header->header_size < sizeof(*header)
+			|| header->region_size < sizeof(struct export_region)) {
+		return false;
+	}
+	uint64_t needed = header->header_size
+		+ (uint64_t)header->capacity * header->region_size;
+	return needed <= size;
+}
+
+int
+export_dump(int fd, FILE *out)
+{
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+		LOG(LOG_ERROR, "export is not sealed against shrinking");
+		return EXIT_FAILURE;
+	}
+	struct stat st;
+	if (fstat(fd, &st)) {
+		LOG_ERRNO(LOG_ERROR, "cannot stat export");
+		return EXIT_FAILURE;
+	}
+	const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+		fd, 0);
+	if (data == MAP_FAILED) {
+		LOG_ERRNO(LOG_ERROR, "cannot map export");
+		return EXIT_FAILURE;
+	}
+	const struct export_header *shared = (const void *)data;
+	if (!check_format(shared, st.st_size)) {
+		LOG(LOG_ERROR, "export has an unknown format");
+		munmap((void *)data, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	struct export_header header;
+	struct export_region *regions = calloc(shared->capacity,
+		sizeof(*regions));
+	bool consistent = false;
+	for (int i = 0; i < EXPORT_READ_RETRIES && !consistent; i++) {
+		uint32_t before = atomic_load_explicit(
+			(_Atomic uint32_t *)&shared->sequence,
+			memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+		memcpy(&header, shared, sizeof(header));
+		uint32_t nr = header.nr_regions < header.capacity
+			? header.nr_regions : header.capacity;
+		for (uint32_t j = 0; j < nr; j++) {
+			memcpy(&regions[j], data + header.header_size
+				+ (size_t)j * header.region_size,
+				sizeof(*regions));
+		}
+		atomic_thread_fence(memory_order_acquire);
+		uint32_t after = atomic_load_explicit(
+			(_Atomic uint32_t *)&shared->sequence,
+			memory_order_relaxed);
+		consistent = before == after;
+	}
+
+	int status = EXIT_FAILURE;
+	if (!consistent) {
+		LOG(LOG_ERROR, "export kept changing while read");
+	} else if (header.nr_regions > header.capacity) {
+		LOG(LOG_ERROR, "export lists more regions than it has room for");
+	} else {
+		if (header.flags & EXPORT_REPLACED) {
+			LOG(LOG_ERROR, "export was replaced by a newer one");
+		} else if (header.flags & EXPORT_TRUNCATED) {
+			LOG(LOG_ERROR, "export holds only some of the regions");
+		}
+		fprintf(out, "# sequence %u, output %ux%u\n",
+			header.sequence, header.output_width,
+			header.output_height);
+		for (uint32_t i = 0; i < header.nr_regions; i++) {
+			struct export_region *r = &regions[i];
+			r->name[sizeof(r->name) - 1] = '\0';
+			fprintf(out, "%s %g %g %g %g\n", r->name, r->x, r->y,
+				r->width, r->height);
+		}
+		status = EXIT_SUCCESS;
+	}
+	free(regions);
+	munmap((void *)data, st.st_size);
+	return status;
+}
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef EXPORT_H
+#define EXPORT_H
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * The region table published in shared memory, for labwc to map instead of
+ * rereading rc.xml. The daemon hands out the memfd in reply to the "export"
+ * command. It is sealed against resizing, and against writable mappings
+ * other than the daemon's own.
+ *
+ * The layout is fixed: an export_header followed by @capacity slots of
+ * export_region, in native byte order, with @nr_regions of them in use.
+ * Readers check @magic and @version, and use @header_size and @region_size
+ * to find the regions, so that later versions may add fields at the end.
+ *
+ * Updates are guarded by @sequence, which is odd while they are written and
+ * only advances when the table changed. Readers copy what they need between
+ * two loads of @sequence, and retry if it was odd or changed in between.
+ *
+ * When the regions outgrow @capacity, the daemon moves to a larger memfd and
+ * sets EXPORT_REPLACED in @flags of the old one, which is no longer updated.
+ * Readers then ask for the export again. Should that fail, the table holds
+ * as many regions as fit and EXPORT_TRUNCATED is set.
+ * The table is empty until the editor has been shown once, as the output
+ * size is not known before that.
+ */
+#define EXPORT_MAGIC "LWCREGNS"
+#define EXPORT_VERSION 1
+/* Regions a new export has room for */
+#define EXPORT_CAPACITY 256
+#define EXPORT_NAME_SIZE 64
+
+enum export_flags {
+	EXPORT_REPLACED = 1 << 0,
+	EXPORT_TRUNCATED = 1 << 1,
+};
+
+struct export_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t region_size;
+	uint32_t capacity;
+	_Atomic uint32_t sequence;
+	uint32_t nr_regions;
+	/* Output size the pixel geometry is for */
+	uint32_t output_width, output_height;
+	/* enum export_flags */
+	uint32_t flags;
+	uint32_t reserved[5];
+};
+
+struct export_region {
+	char name[EXPORT_NAME_SIZE];
+	/* Pixel geometry */
+	double x, y, width, height;
+	/* Geometry as in the config, see FIXED_ONE and enum region_flags */
+	int32_t fx, fy, fwidth, fheight;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct exporter;
+struct region_table;
+
+struct exporter *exporter_create(void);
+void exporter_destroy(struct exporter *exporter);
+
+/*
+ * The memfd to pass on. It stays owned by the exporter, and may change when
+ * a table is published.
+ */
+int exporter_fd(struct exporter *exporter);
+
+/* Publish @table, laid out for an output of @width x @height pixels */
+void exporter_publish(struct exporter *exporter,
+	const struct region_table *table, int width, int height);
+
+/*
+ * Map an exported table, check its seals and format, and print a consistent
+ * snapshot of it to @out. Returns the exit status.
+ */
+int export_dump(int fd, FILE *out);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,403 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+#include "region.h"
+
+/* Bytes of journal kept, after which the oldest gestures are dropped */
+#define HISTORY_SIZE (64 * 1024)
+
+enum field {
+	FIELD_X,
+	FIELD_Y,
+	FIELD_WIDTH,
+	FIELD_HEIGHT,
+	FIELD_COUNT,
+};
+
+/*
+ * Each gesture is journaled as its length as four bytes, its entries, and
+ * the length again, so that it can be found walking either way. An entry is
+ * a varint key of region id, field and kind, followed by either a zigzag
+ * varint delta in 1/FIXED_ONE pixels, or the old and new values in full
+ * where that delta would not restore them exactly.
+ */
+enum entry_kind {
+	ENTRY_DELTA,
+	ENTRY_ABSOLUTE,
+};
+
+struct buffer {
+	uint8_t *data;
+	size_t size, capacity;
+};
+
+struct history {
+	struct region_table *table;
+	region_changed_fn changed;
+	void *data;
+
+	/* Geometry as of the last commit, per field and region id */
+	double *shadow[FIELD_COUNT];
+	int nr_shadow, shadow_capacity;
+
+	/* Regions touched since the last commit */
+	int *touched;
+	int nr_touched, touched_capacity;
+	bool *is_touched;
+
+	/*
+	 * Offsets into the ring grow without wrapping. Gestures from @tail to
+	 * @head can be undone, those from @head to @top redone.
+	 */
+	uint8_t ring[HISTORY_SIZE];
+	uint64_t tail, head, top;
+
+	struct buffer scratch;
+	bool replaying;
+};
+
+static double *
+column(struct region_table *table, enum field field)
+{
+	switch (field) {
+	case FIELD_X:
+		return table->x;
+	case FIELD_Y:
+		return table->y;
+	case FIELD_WIDTH:
+		return table->width;
+	default:
+		return table->height;
+	}
+}
+
+/* Copy the geometry of regions from @first on into the shadow */
+static void
+sync_shadow(struct history *history, int first)
+{
+	struct region_table *table = history->table;
+	if (table->nr > history->shadow_capacity) {
+		int capacity = table->capacity;
+		for (int f = 0; f < FIELD_COUNT; f++) {
+			history->shadow[f] = realloc(history->shadow[f],
+				capacity * sizeof(double));
+		}
+		history->is_touched = realloc(history->is_touched,
+			capacity * sizeof(bool));
+		memset(history->is_touched + history->shadow_capacity, 0,
+			(capacity - history->shadow_capacity) * sizeof(bool));
+		history->shadow_capacity = capacity;
+	}
+	for (int f = 0; f < FIELD_COUNT && table->nr > first; f++) {
+		memcpy(history->shadow[f] + first, column(table, f) + first,
+			(table->nr - first) * sizeof(double));
+	}
+	history->nr_shadow = table->nr;
+}
+
+struct history *
+history_create(struct region_table *table, region_changed_fn changed,
+		void *data)
+{
+	struct history *history = calloc(1, sizeof(struct history));
+	history->table = table;
+	history->changed = changed;
+	history->data = data;
+	sync_shadow(history, 0);
+	return history;
+}
+
+void
+history_destroy(struct history *history)
+{
+	if (!history) {
+		return;
+	}
+	for (int f = 0; f < FIELD_COUNT; f++) {
+		free(history->shadow[f]);
+	}
+	free(history->touched);
+	free(history->is_touched);
+	free(history->scratch.data);
+	free(history);
+}
+
+void
+history_touch(struct history *history, int region)
+{
+	if (history->replaying) {
+		return;
+	}
+	if (region >= history->nr_shadow) {
+		/* Added since the last reset, so there is nothing to go back to */
+		sync_shadow(history, history->nr_shadow);
+	}
+	if (history->is_touched[region]) {
+		return;
+	}
+	if (history->nr_touched == history->touched_capacity) {
+		history->touched_capacity = history->touched_capacity
+			? history->touched_capacity * 2 : 16;
+		history->touched = realloc(history->touched,
+			history->touched_capacity * sizeof(int));
+	}
+	history->touched[history->nr_touched++] = region;
+	history->is_touched[region] = true;
+}
+
+static void
+put_byte(struct buffer *buffer, uint8_t byte)
+{
+	if (buffer->size == buffer->capacity) {
+		buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+		buffer->data = realloc(buffer->data, buffer->capacity);
+	}
+	buffer->data[buffer->size++] = byte;
+}
+
+static void
+put_varint(struct buffer *buffer, uint64_t value)
+{
+	while (value >= 0x80) {
+		put_byte(buffer, (value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	put_byte(buffer, value);
+}
+
+static void
+put_double(struct buffer *buffer, double value)
+{
+	uint8_t bytes[sizeof(double)];
+	memcpy(bytes, &value, sizeof(bytes));
+	for (size_t i = 0; i < sizeof(bytes); i++) {
+		put_byte(buffer, bytes[i]);
+	}
+}
+
+static uint64_t
+get_varint(const uint8_t **p)
+{
+	uint64_t value = 0;
+	for (int shift = 0;; shift += 7) {
+		uint8_t byte = *(*p)++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+}
+
+static double
+get_double(const uint8_t **p)
+{
+	double value;
+	memcpy(&value, *p, sizeof(value));
+	*p += sizeof(value);
+	return value;
+}
+
+static uint64_t
+zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t
+unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void
+encode(struct buffer *buffer, int region, enum field field, double old,
+		double new)
+{
+	uint64_t key = (uint64_t)region << 3 | field << 1;
+	double delta = (new - old) * FIXED_ONE;
+	if (fabs(delta) < (double)INT64_MAX / 2) {
+		int64_t q = llround(delta);
+		double d = (double)q / FIXED_ONE;
+		if (old + d == new && new - d == old) {
+			put_varint(buffer, key | ENTRY_DELTA);
+			put_varint(buffer, zigzag(q));
+			return;
+		}
+	}
+	put_varint(buffer, key | ENTRY_ABSOLUTE);
+	put_double(buffer, old);
+	put_double(buffer, new);
+}
+
+static void
+ring_write(struct history *history, uint64_t offset, const void *src,
+		size_t len)
+{
+	size_t start = offset % HISTORY_SIZE;
+	size_t first = len < HISTORY_SIZE - start ? len : HISTORY_SIZE - start;
+	memcpy(history->ring + start, src, first);
+	memcpy(history->ring, (const uint8_t *)src + first, len - first);
+}
+
+static void
+ring_read(struct history *history, uint64_t offset, void *dst, size_t len)
+{
+	size_t start = offset % HISTORY_SIZE;
+	size_t first = len < HISTORY_SIZE - start ? len : HISTORY_SIZE - start;
+	memcpy(dst, history->ring + start, first);
+	memcpy((uint8_t *)dst + first, history->ring, len - first);
+}
+
+static uint32_t
+ring_read_length(struct history *history, uint64_t offset)
+{
+	uint8_t bytes[4];
+	ring_read(history, offset, bytes, sizeof(bytes));
+	return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static void
+ring_write_length(struct history *history, uint64_t offset, uint32_t len)
+{
+	uint8_t bytes[4] = { len, len >> 8, len >> 16, len >> 24 };
+	ring_write(history, offset, bytes, sizeof(bytes));
+}
+
+static void
+push_gesture(struct history *history, const struct buffer *gesture)
+{
+	size_t total = gesture->size + 8;
+	history->top = history->head;
+	if (total > HISTORY_SIZE) {
+		/* Cannot be journaled, and older gestures would not apply */
+		history->tail = history->head;
+		return;
+	}
+	while (HISTORY_SIZE - (history->head - history->tail) < total) {
+		history->tail += ring_read_length(history, history->tail) + 8;
+	}
+	ring_write_length(history, history->head, gesture->size);
+	ring_write(history, history->head + 4, gesture->data, gesture->size);
+	ring_write_length(history, history->head + 4 + gesture->size,
+		gesture->size);
+	history->head += total;
+	history->top = history->head;
+}
+
+void
+history_commit(struct history *history)
+{
+	if (!history->nr_touched) {
+		return;
+	}
+	struct buffer *scratch = &history->scratch;
+	scratch->size = 0;
+	for (int i = 0; i < history->nr_touched; i++) {
+		int region = history->touched[i];
+		history->is_touched[region] = false;
+		for (int f = 0; f < FIELD_COUNT; f++) {
+			double old = history->shadow[f][region];
+			double new = column(history->table, f)[region];
+			if (old != new) {
+				encode(scratch, region, f, old, new);
+				history->shadow[f][region] = new;
+			}
+		}
+	}
+	history->nr_touched = 0;
+	if (scratch->size) {
+		push_gesture(history, scratch);
+	}
+}
+
+void
+history_reset(struct history *history)
+{
+	for (int i = 0; i < history->nr_touched; i++) {
+		history->is_touched[history->touched[i]] = false;
+	}
+	history->nr_touched = 0;
+	history->tail = history->head = history->top = 0;
+	sync_shadow(history, 0);
+}
+
+/* Play the gesture held in the scratch buffer backwards or forwards */
+static void
+apply(struct history *history, bool undo)
+{
+	const uint8_t *p = history->scratch.data;
+	const uint8_t *end = p + history->scratch.size;
+	int last = -1;
+
+	history->replaying = true;
+	while (p < end) {
+		uint64_t key = get_varint(&p);
+		int region = key >> 3;
+		enum field field = (key >> 1) & 3;
+		double *value = &column(history->table, field)[region];
+		if ((key & 1) == ENTRY_ABSOLUTE) {
+			double old = get_double(&p);
+			double new = get_double(&p);
+			*value = undo ? old : new;
+		} else {
+			double d = (double)unzigzag(get_varint(&p)) / FIXED_ONE;
+			*value = undo ? *value - d : *value + d;
+		}
+		history->shadow[field][region] = *value;
+
+		/* Entries come grouped by region */
+		if (region != last && last >= 0 && history->changed) {
+			history->changed(last, history->data);
+		}
+		last = region;
+	}
+	if (last >= 0 && history->changed) {
+		history->changed(last, history->data);
+	}
+	history->replaying = false;
+}
+
+static void
+load_gesture(struct history *history, uint64_t start, uint32_t len)
+{
+	struct buffer *scratch = &history->scratch;
+	if (len > scratch->capacity) {
+		scratch->capacity = len;
+		scratch->data = realloc(scratch->data, len);
+	}
+	ring_read(history, start + 4, scratch->data, len);
+	scratch->size = len;
+}
+
+bool
+history_undo(struct history *history)
+{
+	history_commit(history);
+	if (history->head == history->tail) {
+		return false;
+	}
+	uint32_t len = ring_read_length(history, history->head - 4);
+	uint64_t start = history->head - len - 8;
+	load_gesture(history, start, len);
+	apply(history, true);
+	history->head = start;
+	return true;
+}
+
+bool
+history_redo(struct history *history)
+{
+	history_commit(history);
+	if (history->head == history->top) {
+		return false;
+	}
+	uint32_t len = ring_read_length(history, history->head);
+	load_gesture(history, history->head, len);
+	apply(history, false);
+	history->head += len + 8;
+	return true;
+}
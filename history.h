@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Undo and redo of region geometry. Changes are collected per gesture, such
+ * as one drag from pointer press to release, and journaled as the net change
+ * of each field that moved. Entries are varint-encoded into a fixed-size ring
+ * buffer, so that the oldest gestures are dropped rather than memory growing
+ * without bound.
+ */
+struct history;
+struct region_table;
+
+/* @changed is called for every region an undo or redo moves */
+struct history *history_create(struct region_table *table,
+	region_changed_fn changed, void *data);
+void history_destroy(struct history *history);
+
+/* Note that @region changed as part of the current gesture */
+void history_touch(struct history *history, int region);
+
+/* End the current gesture, journaling what changed since the last one */
+void history_commit(struct history *history);
+
+/* Forget everything, for when regions are added or removed */
+void history_reset(struct history *history);
+
+bool history_undo(struct history *history);
+bool history_redo(struct history *history);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "ipc.h"
+#include "util.h"
+
+/* Longest command, including its newline */
+#define IPC_COMMAND_SIZE 64
+
+/*
+ * How long the daemon waits for a command, and a client for the reply, in
+ * milliseconds
+ */
+#define IPC_COMMAND_TIMEOUT_MS 100
+#define IPC_REPLY_TIMEOUT_MS 2000
+
+/* Connections the daemon waits on at once, beyond which it turns them away */
+#define IPC_MAX_CLIENTS 16
+
+struct ipc_client {
+	struct ipc *ipc;
+	int fd;
+	char command[IPC_COMMAND_SIZE];
+	size_t len;
+	struct loop_timer *timeout;
+	struct ipc_client *next;
+};
+
+struct ipc {
+	struct loop *loop;
+	int fd;
+	struct sockaddr_un addr;
+	ipc_command_fn fn;
+	void *data;
+	struct ipc_client *clients;
+	int nr_clients;
+};
+
+static bool
+socket_address(struct sockaddr_un *addr)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	if (!dir) {
+		LOG(LOG_ERROR, "XDG_RUNTIME_DIR is not set");
+		return false;
+	}
+	const char *display = getenv("WAYLAND_DISPLAY");
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	int n = snprintf(addr->sun_path, sizeof(addr->sun_path),
+		"%s/labwc-regions.%s.sock", dir, display ? display : "wayland-0");
+	if (n < 0 || (size_t)n >= sizeof(addr->sun_path)) {
+		LOG(LOG_ERROR, "socket path too long");
+		return false;
+	}
+	return true;
+}
+
+static void
+set_timeout(int fd, int ms)
+{
+	struct timeval timeout = {
+		.tv_sec = ms / 1000,
+		.tv_usec = ms % 1000 * 1000,
+	};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/*
+ * Receive up to @len bytes. A file descriptor passed along with them is
+ * stored in @passed if that is non-NULL and still -1, and closed otherwise.
+ */
+static ssize_t
+receive(int fd, char *buf, size_t len, int *passed, int flags)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	ssize_t ret = recvmsg(fd, &msg, flags | MSG_CMSG_CLOEXEC);
+	if (ret < 0) {
+		return ret;
+	}
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET
+			&& cmsg->cmsg_type == SCM_RIGHTS) {
+		int received;
+		memcpy(&received, CMSG_DATA(cmsg), sizeof(received));
+		if (passed && *passed < 0) {
+			*passed = received;
+		} else {
+			close(received);
+		}
+	}
+	return ret;
+}
+
+/* Cut @buf, holding @n bytes, at its first newline if it has one */
+static bool
+end_line(char *buf, size_t n)
+{
+	buf[n] = '\0';
+	char *newline = memchr(buf, '\n', n);
+	if (!newline) {
+		return false;
+	}
+	*newline = '\0';
+	return true;
+}
+
+/*
+ * Read a line, without its newline, returning false if none came. See
+ * receive() for @passed.
+ */
+static bool
+read_line(int fd, char *buf, size_t len, int *passed)
+{
+	size_t n = 0;
+	while (n < len - 1) {
+		ssize_t ret = receive(fd, buf + n, len - 1 - n, passed, 0);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		n += ret;
+		if (memchr(buf, '\n', n)) {
+			break;
+		}
+	}
+	return end_line(buf, n);
+}
+
+static void
+send_reply(int fd, const char *reply, int passed)
+{
+	struct iovec iov = {
+		.iov_base = (void *)reply,
+		.iov_len = strlen(reply),
+	};
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	if (passed >= 0) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &passed, sizeof(passed));
+	}
+	sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
+static void
+client_destroy(struct ipc_client *client)
+{
+	struct ipc *ipc = client->ipc;
+	struct ipc_client **link = &ipc->clients;
+	while (*link != client) {
+		link = &(*link)->next;
+	}
+	*link = client->next;
+	ipc->nr_clients--;
+
+	if (client->timeout) {
+		loop_remove_timer(ipc->loop, client->timeout);
+	}
+	loop_remove_fd(ipc->loop, client->fd);
+	close(client->fd);
+	free(client);
+}
+
+static void
+client_timeout(void *data)
+{
+	struct ipc_client *client = data;
+	/* The loop frees the timer once this returns */
+	client->timeout = NULL;
+	client_destroy(client);
+}
+
+/*
+ * Clients are read from the loop as their data arrives, so that one that
+ * is slow to send its command holds nothing else up. The reply is a few
+ * bytes into an empty socket buffer, so it is sent right away.
+ */
+static void
+handle_client(int fd, short mask, void *data)
+{
+	struct ipc_client *client = data;
+	struct ipc *ipc = client->ipc;
+	size_t room = sizeof(client->command) - 1 - client->len;
+	ssize_t ret = receive(fd, client->command + client->len, room, NULL,
+		MSG_DONTWAIT);
+	if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+			|| errno == EINTR)) {
+		return;
+	}
+	if (ret <= 0) {
+		client_destroy(client);
+		return;
+	}
+	client->len += ret;
+	bool complete = end_line(client->command, client->len);
+	if (!complete && client->len < sizeof(client->command) - 1) {
+		return;
+	}
+
+	int passed = -1;
+	bool ok = complete && ipc->fn(client->command, &passed, ipc->data);
+	send_reply(fd, ok ? "ok\n" : "error\n", ok ? passed : -1);
+	client_destroy(client);
+}
+
+static void
+handle_connection(int fd, short mask, void *data)
+{
+	struct ipc *ipc = data;
+	int client_fd;
+	while ((client_fd = accept(fd, NULL, NULL)) >= 0) {
+		if (ipc->nr_clients == IPC_MAX_CLIENTS) {
+			LOG(LOG_ERROR, "too many IPC clients, turning one away");
+			close(client_fd);
+			continue;
+		}
+		fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+		fcntl(client_fd, F_SETFL, O_NONBLOCK);
+
+		struct ipc_client *client = calloc(1, sizeof(*client));
+		client->ipc = ipc;
+		client->fd = client_fd;
+		client->next = ipc->clients;
+		ipc->clients = client;
+		ipc->nr_clients++;
+		client->timeout = loop_add_timer(ipc->loop,
+			IPC_COMMAND_TIMEOUT_MS, client_timeout, client);
+		loop_add_fd(ipc->loop, client_fd, POLLIN, handle_client,
+			client);
+	}
+}
+
+/* Whether a daemon answers on @addr, as opposed to a stale socket file */
+static bool
+daemon_running(const struct sockaddr_un *addr)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+	bool running = !connect(fd, (const struct sockaddr *)addr,
+		sizeof(*addr));
+	close(fd);
+	return running;
+}
+
+struct ipc *
+ipc_listen(ipc_command_fn fn, void *data)
+{
+	struct ipc *ipc = calloc(1, sizeof(*ipc));
+	ipc->fn = fn;
+	ipc->data = data;
+	if (!socket_address(&ipc->addr)) {
+		free(ipc);
+		return NULL;
+	}
+
+	ipc->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		0);
+	if (ipc->fd < 0) {
+		LOG_ERRNO(LOG_ERROR, "cannot create socket");
+		free(ipc);
+		return NULL;
+	}
+	const struct sockaddr *addr = (const struct sockaddr *)&ipc->addr;
+	int ret = bind(ipc->fd, addr, sizeof(ipc->addr));
+	if (ret && errno == EADDRINUSE) {
+		if (daemon_running(&ipc->addr)) {
+			LOG(LOG_ERROR, "a daemon is running already");
+			close(ipc->fd);
+			free(ipc);
+			return NULL;
+		}
+		/* Left behind by a daemon that did not exit cleanly */
+		unlink(ipc->addr.sun_path);
+		ret = bind(ipc->fd, addr, sizeof(ipc->addr));
+	}
+	if (ret || listen(ipc->fd, 4)) {
+		LOG_ERRNO(LOG_ERROR, "cannot listen on %s", ipc->addr.sun_path);
+		close(ipc->fd);
+		free(ipc);
+		return NULL;
+	}
+	return ipc;
+}
+
+void
+ipc_attach(struct ipc *ipc, struct loop *loop)
+{
+	ipc->loop = loop;
+	loop_add_fd(loop, ipc->fd, POLLIN, handle_connection, ipc);
+}
+
+void
+ipc_destroy(struct ipc *ipc)
+{
+	if (!ipc) {
+		return;
+	}
+	while (ipc->clients) {
+		client_destroy(ipc->clients);
+	}
+	if (ipc->loop) {
+		loop_remove_fd(ipc->loop, ipc->fd);
+	}
+	close(ipc->fd);
+	unlink(ipc->addr.sun_path);
+	free(ipc);
+}
+
+int
+ipc_send(const char *command, int *passed)
+{
+	struct sockaddr_un addr;
+	if (!socket_address(&addr)) {
+		return EXIT_FAILURE;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		LOG_ERRNO(LOG_ERROR, "cannot create socket");
+		return EXIT_FAILURE;
+	}
+	if (connect(fd, (const struct sockaddr *)&addr, sizeof(addr))) {
+		LOG(LOG_ERROR, "no daemon is running (%s)", addr.sun_path);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	set_timeout(fd, IPC_REPLY_TIMEOUT_MS);
+
+	char line[IPC_COMMAND_SIZE];
+	int n = snprintf(line, sizeof(line), "%s\n", command);
+	if (n < 0 || (size_t)n >= sizeof(line)) {
+		LOG(LOG_ERROR, "command too long");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	char reply[IPC_COMMAND_SIZE];
+	bool ok = send(fd, line, n, MSG_NOSIGNAL) == n
+		&& read_line(fd, reply, sizeof(reply), passed)
+		&& !strcmp(reply, "ok");
+	close(fd);
+	if (!ok) {
+		LOG(LOG_ERROR, "daemon did not accept '%s'", command);
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
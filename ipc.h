@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef IPC_H
+#define IPC_H
+#include <stdbool.h>
+
+/*
+ * Commands to a running daemon over a Unix socket in $XDG_RUNTIME_DIR, one
+ * per Wayland display. A command is a single line, answered with "ok" or
+ * "error" before the connection is closed. A reply may carry a file
+ * descriptor, as that to "export" does.
+ */
+struct ipc;
+struct loop;
+
+/*
+ * Returns whether @command was understood. Setting @fd passes that file
+ * descriptor along with the reply, without giving up ownership of it.
+ */
+typedef bool (*ipc_command_fn)(const char *command, int *fd, void *data);
+
+/*
+ * Take the socket and listen on it, or return NULL if a daemon is running.
+ * This needs no Wayland connection, so a second daemon can stop before
+ * making one. Commands wait until the socket is attached to @loop.
+ */
+struct ipc *ipc_listen(ipc_command_fn fn, void *data);
+void ipc_attach(struct ipc *ipc, struct loop *loop);
+void ipc_destroy(struct ipc *ipc);
+
+/*
+ * Send @command to the daemon, returning the exit status. A file descriptor
+ * passed with the reply is stored in @fd, which should be -1 beforehand, or
+ * closed if @fd is NULL.
+ */
+int ipc_send(const char *command, int *fd);
+
+#endif /* IPC_H */
@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+#include "region.h"
+
+struct layout {
+	struct region_table *table;
+
+	struct layout_node **roots;
+	int nr_roots, capacity;
+
+	/* The leaf of each region id, or NULL */
+	struct layout_node **leaves;
+	int nr_leaves;
+
+	region_changed_fn changed;
+	void *data;
+};
+
+static void
+add_root(struct layout *layout, struct layout_node *node)
+{
+	if (layout->nr_roots == layout->capacity) {
+		layout->capacity = layout->capacity ? layout->capacity * 2 : 8;
+		layout->roots = realloc(layout->roots,
+			layout->capacity * sizeof(struct layout_node *));
+	}
+	layout->roots[layout->nr_roots++] = node;
+}
+
+/* Put @new where @old was, either in its parent or among the roots */
+static void
+replace_node(struct layout *layout, struct layout_node *old,
+		struct layout_node *new)
+{
+	struct layout_node *parent = old->parent;
+	new->parent = parent;
+	if (parent) {
+		int i = parent->children[0] == old ? 0 : 1;
+		parent->children[i] = new;
+		return;
+	}
+	for (int i = 0; i < layout->nr_roots; i++) {
+		if (layout->roots[i] == old) {
+			layout->roots[i] = new;
+			return;
+		}
+	}
+}
+
+static struct layout_node *
+leaf_create(struct layout *layout, int region, const struct dbox *box)
+{
+	struct layout_node *leaf = calloc(1, sizeof(struct layout_node));
+	leaf->type = LAYOUT_LEAF;
+	leaf->box = *box;
+	leaf->region = region;
+
+	if (region >= layout->nr_leaves) {
+		int nr = layout->nr_leaves ? layout->nr_leaves : 32;
+		while (nr <= region) {
+			nr *= 2;
+		}
+		layout->leaves = realloc(layout->leaves,
+			nr * sizeof(struct layout_node *));
+		memset(layout->leaves + layout->nr_leaves, 0,
+			(nr - layout->nr_leaves) * sizeof(struct layout_node *));
+		layout->nr_leaves = nr;
+	}
+	layout->leaves[region] = leaf;
+	return leaf;
+}
+
+static struct layout_node *
+leaf_of(struct layout *layout, int region)
+{
+	return region < layout->nr_leaves ? layout->leaves[region] : NULL;
+}
+
+static void
+child_boxes(const struct layout_node *node, struct dbox boxes[static 2])
+{
+	boxes[0] = node->box;
+	boxes[1] = node->box;
+	if (node->type == LAYOUT_SPLIT_H) {
+		boxes[0].width = node->box.width * node->ratio;
+		boxes[1].x += boxes[0].width;
+		boxes[1].width -= boxes[0].width;
+	} else {
+		boxes[0].height = node->box.height * node->ratio;
+		boxes[1].y += boxes[0].height;
+		boxes[1].height -= boxes[0].height;
+	}
+}
+
+/* Lay out the subtree at @node into @box, reporting regions that moved */
+static void
+relayout(struct layout *layout, struct layout_node *node,
+		const struct dbox *box)
+{
+	node->box = *box;
+	if (node->type == LAYOUT_LEAF) {
+		struct dbox old = region_box(layout->table, node->region);
+		if (memcmp(&old, box, sizeof(*box))) {
+			region_set_box(layout->table, node->region, box);
+			if (layout->changed) {
+				layout->changed(node->region, layout->data);
+			}
+		}
+		return;
+	}
+	struct dbox boxes[2];
+	child_boxes(node, boxes);
+	relayout(layout, node->children[0], &boxes[0]);
+	relayout(layout, node->children[1], &boxes[1]);
+}
+
+/* A region as seen by the tree inference */
+struct item {
+	int region;
+	/* Start and end along x and y */
+	double start[2], end[2];
+};
+
+static int
+compare_x(const void *a, const void *b)
+{
+	double x = ((const struct item *)a)->start[0];
+	double y = ((const struct item *)b)->start[0];
+	return (x > y) - (x < y);
+}
+
+static int
+compare_y(const void *a, const void *b)
+{
+	double x = ((const struct item *)a)->start[1];
+	double y = ((const struct item *)b)->start[1];
+	return (x > y) - (x < y);
+}
+
+/*
+ * Sort @items along the axis of @type and look for a line that no region
+ * crosses, preferring the one nearest the middle of @box. Returns the number
+ * of regions before the line, or 0 if there is none.
+ */
+static int
+find_cut(struct item *items, int nr, enum layout_type type,
+		const struct dbox *box, double *cut)
+{
+	int axis = type == LAYOUT_SPLIT_H ? 0 : 1;
+	qsort(items, nr, sizeof(struct item), axis ? compare_y : compare_x);
+
+	double middle = type == LAYOUT_SPLIT_H
+		? box->x + box->width / 2 : box->y + box->height / 2;
+	double end = -INFINITY;
+	int best = 0;
+	for (int i = 0; i < nr - 1; i++) {
+		end = fmax(end, items[i].end[axis]);
+		if (end > items[i + 1].start[axis]) {
+			continue;
+		}
+		if (!best || fabs(end - middle) < fabs(*cut - middle)) {
+			best = i + 1;
+			*cut = end;
+		}
+	}
+	return best;
+}
+
+static void
+bounding_box(struct dbox *dst, const struct dbox *a, const struct dbox *b)
+{
+	double x1 = fmin(a->x, b->x);
+	double y1 = fmin(a->y, b->y);
+	double x2 = fmax(a->x + a->width, b->x + b->width);
+	double y2 = fmax(a->y + a->height, b->y + b->height);
+	*dst = (struct dbox){ x1, y1, x2 - x1, y2 - y1 };
+}
+
+/* Fit the box and ratio of split @node to those of its children */
+static void
+fit_to_children(struct layout_node *node)
+{
+	struct dbox *a = &node->children[0]->box;
+	struct dbox *b = &node->children[1]->box;
+	bounding_box(&node->box, a, b);
+	if (node->type == LAYOUT_SPLIT_H) {
+		node->ratio = node->box.width > 0
+			? (a->x + a->width - node->box.x) / node->box.width
+			: 0.5;
+	} else {
+		node->ratio = node->box.height > 0
+			? (a->y + a->height - node->box.y) / node->box.height
+			: 0.5;
+	}
+}
+
+/*
+ * Infer a tree for @regions laid out within @box. Where no guillotine cut
+ * exists the regions are made roots of their own and NULL is returned.
+ *
+ * Every node gets the box its regions actually take up, rather than the
+ * part of @box it was cut from, so that a later relayout never stretches
+ * regions into space that is not theirs.
+ */
+static struct layout_node *
+build(struct layout *layout, struct item *items, int nr,
+		const struct dbox *box)
+{
+	if (nr == 1) {
+		struct dbox own = region_box(layout->table, items[0].region);
+		return leaf_create(layout, items[0].region, &own);
+	}
+
+	enum layout_type type = LAYOUT_SPLIT_H;
+	double cut;
+	int n = find_cut(items, nr, type, box, &cut);
+	if (!n) {
+		type = LAYOUT_SPLIT_V;
+		n = find_cut(items, nr, type, box, &cut);
+	}
+	if (!n) {
+		for (int i = 0; i < nr; i++) {
+			struct dbox own = region_box(layout->table,
+				items[i].region);
+			add_root(layout, leaf_create(layout, items[i].region,
+				&own));
+		}
+		return NULL;
+	}
+
+	struct dbox boxes[2] = { *box, *box };
+	if (type == LAYOUT_SPLIT_H) {
+		boxes[0].width = cut - box->x;
+		boxes[1].x = cut;
+		boxes[1].width -= boxes[0].width;
+	} else {
+		boxes[0].height = cut - box->y;
+		boxes[1].y = cut;
+		boxes[1].height -= boxes[0].height;
+	}
+	struct layout_node *a = build(layout, items, n, &boxes[0]);
+	struct layout_node *b = build(layout, items + n, nr - n, &boxes[1]);
+	if (!a || !b) {
+		/*
+		 * Nothing above may claim the space of the regions left as
+		 * roots, so what could be inferred becomes a root as well
+		 */
+		if (a || b) {
+			add_root(layout, a ? a : b);
+		}
+		return NULL;
+	}
+
+	struct layout_node *node = calloc(1, sizeof(struct layout_node));
+	node->type = type;
+	node->children[0] = a;
+	node->children[1] = b;
+	a->parent = node;
+	b->parent = node;
+	fit_to_children(node);
+	return node;
+}
+
+struct layout *
+layout_create(struct region_table *table, double width, double height,
+		region_changed_fn changed, void *data)
+{
+	struct layout *layout = calloc(1, sizeof(struct layout));
+	layout->table = table;
+	layout->changed = changed;
+	layout->data = data;
+
+	struct item *items = calloc(table->nr ? table->nr : 1,
+		sizeof(struct item));
+	int nr = 0;
+	region_for_each(table, id) {
+		items[nr++] = (struct item){
+			.region = id,
+			.start = { table->x[id], table->y[id] },
+			.end = {
+				table->x[id] + table->width[id],
+				table->y[id] + table->height[id],
+			},
+		};
+	}
+	if (nr) {
+		struct dbox box = { 0, 0, width, height };
+		struct layout_node *root = build(layout, items, nr, &box);
+		if (root) {
+			add_root(layout, root);
+		}
+	}
+	free(items);
+	return layout;
+}
+
+static void
+node_destroy(struct layout_node *node)
+{
+	if (node->type != LAYOUT_LEAF) {
+		node_destroy(node->children[0]);
+		node_destroy(node->children[1]);
+	}
+	free(node);
+}
+
+void
+layout_destroy(struct layout *layout)
+{
+	if (!layout) {
+		return;
+	}
+	for (int i = 0; i < layout->nr_roots; i++) {
+		node_destroy(layout->roots[i]);
+	}
+	free(layout->roots);
+	free(layout->leaves);
+	free(layout);
+}
+
+bool
+layout_has_region(struct layout *layout, int region)
+{
+	return leaf_of(layout, region);
+}
+
+void
+layout_split(struct layout *layout, int region, enum layout_type type,
+		int new)
+{
+	struct layout_node *leaf = leaf_of(layout, region);
+	struct dbox box = region_box(layout->table, region);
+	assert(leaf);
+
+	struct layout_node *node = calloc(1, sizeof(struct layout_node));
+	node->type = type;
+	node->ratio = 0.5;
+	replace_node(layout, leaf, node);
+
+	node->children[0] = leaf;
+	node->children[1] = leaf_create(layout, new, &box);
+	leaf->parent = node;
+	node->children[1]->parent = node;
+
+	relayout(layout, node, &box);
+}
+
+bool
+layout_merge(struct layout *layout, int region)
+{
+	struct layout_node *leaf = leaf_of(layout, region);
+	struct layout_node *parent = leaf ? leaf->parent : NULL;
+	if (!parent) {
+		return false;
+	}
+	struct layout_node *sibling = parent->children[0] == leaf
+		? parent->children[1] : parent->children[0];
+	struct dbox box = parent->box;
+
+	replace_node(layout, parent, sibling);
+	free(parent);
+	free(leaf);
+	layout->leaves[region] = NULL;
+
+	relayout(layout, sibling, &box);
+	return true;
+}
+
+void
+layout_refresh(struct layout *layout, int region)
+{
+	struct layout_node *node = leaf_of(layout, region);
+	if (!node) {
+		return;
+	}
+	node->box = region_box(layout->table, region);
+	for (node = node->parent; node; node = node->parent) {
+		fit_to_children(node);
+	}
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef LAYOUT_H
+#define LAYOUT_H
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Regions described as a binary space partition. Each split node divides its
+ * box in two at @ratio, either side by side (LAYOUT_SPLIT_H, like i3's
+ * "split h") or stacked (LAYOUT_SPLIT_V). Leaves hold one region each.
+ *
+ * The tree is inferred from the regions in the config by looking for
+ * guillotine cuts. Regions that cannot be described that way, for example
+ * because they overlap, become trees of their own and are left alone.
+ *
+ * Edits only lay out the subtree they touch. Every region whose box changes
+ * is passed to the callback given to layout_create(), so that callers can
+ * update whatever else they keep about it.
+ */
+enum layout_type {
+	LAYOUT_LEAF,
+	LAYOUT_SPLIT_H,
+	LAYOUT_SPLIT_V,
+};
+
+struct layout_node {
+	enum layout_type type;
+	struct dbox box;
+	struct layout_node *parent;
+
+	/* LAYOUT_SPLIT_H and LAYOUT_SPLIT_V */
+	double ratio;
+	struct layout_node *children[2];
+
+	/* LAYOUT_LEAF, the region id */
+	int region;
+};
+
+struct layout;
+struct region_table;
+
+struct layout *layout_create(struct region_table *table, double width,
+	double height, region_changed_fn changed, void *data);
+void layout_destroy(struct layout *layout);
+
+/* Whether @region has a leaf in the layout, and so can be split */
+bool layout_has_region(struct layout *layout, int region);
+
+/*
+ * Split @region in two, giving the right (LAYOUT_SPLIT_H) or bottom
+ * (LAYOUT_SPLIT_V) half to @new, which must not be in the layout yet.
+ * @region must be in the layout.
+ */
+void layout_split(struct layout *layout, int region, enum layout_type type,
+	int new);
+
+/*
+ * Take @region out of the layout, giving its space to its sibling. Returns
+ * false if it has no sibling to merge into.
+ */
+bool layout_merge(struct layout *layout, int region);
+
+/*
+ * Bring the tree back in step after @region was resized by other means, for
+ * example by the constraint solver, by fitting its ancestors to their
+ * children again
+ */
+void layout_refresh(struct layout *layout, int region);
+
+#endif /* LAYOUT_H */
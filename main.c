@@ -1,34 +1,132 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "batch.h"
+#include "export.h"
+#include "ipc.h"
+#include "layout.h"
+#include "preset.h"
 #include "settings.h"
+#include "spatial.h"
 #include "types.h"
 #include "window.h"
 
-static void
+static bool
 send_signal_to_labwc_pid(int signal)
 {
 	char *labwc_pid = getenv("LABWC_PID");
 	if (!labwc_pid) {
-		exit(EXIT_FAILURE);
+		return false;
 	}
 	int pid = atoi(labwc_pid);
 	if (!pid) {
-		exit(EXIT_FAILURE);
+		return false;
 	}
 	kill(pid, signal);
+	return true;
+}
+
+/*
+ * The daemon's editor was closed, so hand the regions over to labwc, if they
+ * changed
+ */
+static void
+save_regions(struct window *window)
+{
+	struct state *state = window->data;
+	if (settings_save(state->config, window->surface->width,
+			window->surface->height) <= 0) {
+		return;
+	}
+	if (!send_signal_to_labwc_pid(SIGHUP)) {
+		LOG(LOG_ERROR, "cannot signal labwc, LABWC_PID is not set");
+	}
+}
+
+static bool
+handle_command(const char *command, int *fd, void *data)
+{
+	struct window *window = data;
+	struct state *state = window->data;
+	if (!strcmp(command, "show")) {
+		window_show(window);
+	} else if (!strcmp(command, "hide")) {
+		window_hide(window);
+	} else if (!strcmp(command, "toggle")) {
+		if (window->visible) {
+			window_hide(window);
+		} else {
+			window_show(window);
+		}
+	} else if (!strcmp(command, "quit")) {
+		window->run_display = false;
+	} else if (!strcmp(command, "export") && state->config->exporter) {
+		*fd = exporter_fd(state->config->exporter);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/* Runs on a helper thread, while the connection to the compositor is set up */
+static void *
+load_config(void *data)
+{
+	struct state *state = data;
+	state->config->regions = settings_init(state->config->filename);
+	state->config->presets = preset_library_open();
+	window_startup_mark(state->window, "config parsed");
+	return NULL;
 }
 
 static const struct option long_options[] = {
+	{"batch", no_argument, NULL, 'b'},
 	{"config", required_argument, NULL, 'c'},
+	{"daemon", no_argument, NULL, 'd'},
+	{"fractional", no_argument, NULL, 'f'},
+	{"gap", required_argument, NULL, 'g'},
 	{"help", no_argument, NULL, 'h'},
+	{"ipc", required_argument, NULL, 'i'},
+	{"jobs", required_argument, NULL, 'j'},
+	{"list-presets", no_argument, NULL, 'l'},
+	{"output-size", required_argument, NULL, 'o'},
+	{"preset", required_argument, NULL, 'p'},
+	{"rename", required_argument, NULL, 'r'},
+	{"snap", required_argument, NULL, 's'},
+	{"scale", required_argument, NULL, 'S'},
+	{"startup-profile", no_argument, NULL, 'P'},
+	{"threads", required_argument, NULL, 't'},
+	{"validate", no_argument, NULL, 'v'},
 	{0, 0, 0, 0}
 };
 
 static const char regions_usage[] =
 "Usage: labwc-regions [options...]\n"
+"       labwc-regions --batch [options...] <file>...\n"
+"  -b, --batch              Edit the given files without opening a surface\n"
 "  -c, --config <file>      Specify config file (with path)\n"
-"  -h, --help               Show help message and quit\n";
+"  -d, --daemon             Stay running, hidden until shown with --ipc\n"
+"  -f, --fractional         Save geometry with fractional percentages\n"
+"  -g, --gap <px>           Gap kept between regions when resizing\n"
+"  -h, --help               Show help message and quit\n"
+"  -i, --ipc <command>      Send show, hide, toggle or quit to the daemon, or\n"
+"                           export to print the regions it shares with labwc\n"
+"  -l, --list-presets       List the named layout presets and quit\n"
+"  -P, --startup-profile    Print how long startup takes, up to the first frame\n"
+"  -s, --snap <px>          Snap distance when dragging (default 10, 0 = off)\n"
+"  -t, --threads <n>        Rasterize frames in tiles on <n> threads\n"
+"Batch options:\n"
+"  -j, --jobs <n>           Files worked on at once (default one per CPU)\n"
+"  -o, --output-size <WxH>  Output size percentages refer to (default 1920x1080)\n"
+"  -p, --preset <name>      Lay out regions in a named preset, or as\n"
+"                           columns-<n>, rows-<n> or grid-<c>x<r>\n"
+"  -r, --rename <old>=<new> Rename a region (may be repeated)\n"
+"  -S, --scale <factor>     Scale all region geometry\n"
+"  -v, --validate           Fail files whose regions overlap or are outside\n"
+"                           the output\n";
 
 static void
 usage(void)
@@ -37,41 +135,168 @@ usage(void)
 	exit(0);
 }
 
+/* Most pixels --gap and --snap take, well beyond any sensible setting */
+#define MAX_DISTANCE_OPTION 1000
+
+static int
+online_cpus(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? cpus : 1;
+}
+
+/*
+ * Parse the argument of option @name as a whole number of at least @min.
+ * Larger values than @max are brought down to it.
+ */
+static int
+parse_int(const char *name, const char *s, int min, int max)
+{
+	char *end;
+	errno = 0;
+	long value = strtol(s, &end, 10);
+	if (errno || end == s || *end || value < min) {
+		LOG(LOG_ERROR, "invalid --%s '%s', expected a number of at "
+			"least %d", name, s, min);
+		exit(EXIT_FAILURE);
+	}
+	return value < max ? value : max;
+}
+
 int
 main(int argc, char *argv[])
 {
 	struct state state = { 0 };
 	struct config config = { 0 };
 	struct window window = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &window.startup_time);
 
 	state.config = &config;
 	state.window = &window;
 	window.data = &state;
+	window.snap_threshold = 10;
 
+	struct batch batch = {
+		.width = 1920,
+		.height = 1080,
+		.scale = 1,
+	};
+	bool opt_batch = false;
+	bool opt_list_presets = false;
 	char *opt_config_file = NULL;
+	char *opt_ipc = NULL;
 	int c;
 	while (1) {
 		int index = 0;
-		c = getopt_long(argc, argv, "c:h", long_options, &index);
+		c = getopt_long(argc, argv, "bc:dfg:hi:j:lo:Pp:r:s:S:t:v",
+			long_options, &index);
 		if (c == -1) {
 			break;
 		}
 		switch (c) {
+		case 'b':
+			opt_batch = true;
+			break;
 		case 'c':
 			opt_config_file = optarg;
 			break;
+		case 'd':
+			window.daemon = true;
+			break;
+		case 'f':
+			config.fractional_percent = true;
+			batch.fractional_percent = true;
+			break;
+		case 'g':
+			window.region_gap = parse_int("gap", optarg, 0,
+				MAX_DISTANCE_OPTION);
+			break;
+		case 'i':
+			opt_ipc = optarg;
+			break;
+		case 'j':
+			batch.jobs = parse_int("jobs", optarg, 1,
+				online_cpus());
+			break;
+		case 'l':
+			opt_list_presets = true;
+			break;
+		case 'o':
+			if (sscanf(optarg, "%dx%d", &batch.width,
+					&batch.height) != 2 || batch.width <= 0
+					|| batch.height <= 0) {
+				usage();
+			}
+			break;
+		case 'P':
+			window.startup_profile = true;
+			break;
+		case 'p':
+			batch.preset = optarg;
+			break;
+		case 'r':
+			batch.renames = realloc(batch.renames,
+				(batch.nr_renames + 1) * sizeof(char *));
+			batch.renames[batch.nr_renames++] = optarg;
+			break;
+		case 's':
+			window.snap_threshold = parse_int("snap", optarg, 0,
+				MAX_DISTANCE_OPTION);
+			break;
+		case 'S':
+			batch.scale = atof(optarg);
+			if (batch.scale <= 0) {
+				usage();
+			}
+			break;
+		case 't':
+			window.render_threads = parse_int("threads", optarg, 1,
+				online_cpus());
+			break;
+		case 'v':
+			batch.validate = true;
+			break;
 		case 'h':
 		default:
 			usage();
 		}
 	}
-	if (optind < argc) {
-		usage();
-	}
 
 	log_init(LOG_DEBUG);
 
-	window_init(&window);
+	if (opt_ipc) {
+		int fd = -1;
+		int status = ipc_send(opt_ipc, &fd);
+		if (fd >= 0) {
+			if (status == EXIT_SUCCESS) {
+				status = export_dump(fd, stdout);
+			}
+			close(fd);
+		}
+		return status;
+	}
+	if (opt_list_presets) {
+		config.presets = preset_library_open();
+		for (int i = 0; i < preset_count(config.presets); i++) {
+			printf("%s\n", preset_name(config.presets, i));
+		}
+		preset_library_close(config.presets);
+		return 0;
+	}
+	if (opt_batch) {
+		if (optind == argc) {
+			usage();
+		}
+		config.presets = preset_library_open();
+		batch.presets = config.presets;
+		int status = batch_run(&batch, argv + optind, argc - optind);
+		free(batch.renames);
+		preset_library_close(config.presets);
+		return status;
+	}
+	if (optind < argc) {
+		usage();
+	}
 
 	if (opt_config_file) {
 		strcpy(config.filename, opt_config_file);
@@ -80,13 +305,59 @@ main(int argc, char *argv[])
 			"%s/.config/labwc/rc.xml", getenv("HOME"));
 	}
 
-	state.config->regions = settings_init(state.config->filename);
+	/* Before the Wayland handshake, which a second daemon need not make */
+	struct ipc *ipc = NULL;
+	if (window.daemon) {
+		ipc = ipc_listen(handle_command, &window);
+		if (!ipc) {
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/*
+	 * Nothing needs the config until the surface is first configured, so
+	 * read it while the Wayland handshake is under way. libxml2 must be
+	 * set up on the main thread before any other uses it.
+	 */
+	xmlInitParser();
+	pthread_t loader;
+	bool threaded = !pthread_create(&loader, NULL, load_config, &state);
+	if (!threaded) {
+		load_config(&state);
+	}
+
+	window_init(&window);
+
+	if (window.daemon) {
+		window.hidden = save_regions;
+		ipc_attach(ipc, window.eventloop);
+		config.exporter = exporter_create();
+	}
+
+	if (threaded) {
+		pthread_join(loader, NULL);
+	}
+	window_startup_mark(&window, "config ready");
 
 	window_run(&window);
 
-	settings_save(&state);
+	int saved = 0;
+	if (window.daemon) {
+		/* Saves if the editor is up, like closing it would */
+		window_hide(&window);
+		ipc_destroy(ipc);
+		exporter_destroy(config.exporter);
+	} else {
+		saved = settings_save(&config, window.surface->width,
+			window.surface->height);
+	}
+	layout_destroy(config.layout);
+	spatial_index_destroy(config.index);
 	settings_finish();
-	send_signal_to_labwc_pid(SIGHUP);
+	preset_library_close(config.presets);
+	if (saved < 0 || (saved && !send_signal_to_labwc_pid(SIGHUP))) {
+		exit(EXIT_FAILURE);
+	}
 
 	/* 
 	 * Finish window after saving settings because window width/height is
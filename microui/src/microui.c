@@ -46,6 +46,13 @@
     (stk).idx--;           \
   } while (0)
 
+/* commands are padded so that those holding pointers stay aligned */
+#define COMMAND_ALIGN sizeof(void*)
+#define MAX_COMMAND_SIZE 0xffff
+
+#define command_at(ctx, offset) \
+  ((mu_Command*) ((ctx)->command_list.items + (offset)))
+
 
 static mu_Rect unclipped_rect = { 0, 0, 0x1000000, 0x1000000 };
 
@@ -115,6 +122,11 @@ static int rect_overlaps_vec2(mu_Rect r, mu_Vec2 p) {
 }
 
 
+static int rects_overlap(mu_Rect a, mu_Rect b) {
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+
 static void draw_frame(mu_Context *ctx, mu_Rect rect, int colorid) {
   mu_draw_rect(ctx, rect, ctx->style->colors[colorid]);
   if (colorid == MU_COLOR_SCROLLBASE  ||
@@ -135,6 +147,32 @@ void mu_init(mu_Context *ctx) {
 }
 
 
+void mu_finish(mu_Context *ctx) {
+  int n;
+  /* containers were allocated in blocks, each as large as the pool was */
+  if (ctx->container_pool_size) { free(ctx->containers[0]); }
+  for (n = MU_CONTAINERPOOL_SIZE; n < ctx->container_pool_size; n *= 2) {
+    free(ctx->containers[n]);
+  }
+  free(ctx->containers);
+  free(ctx->container_pool);
+  ctx->containers = NULL;
+  ctx->container_pool = NULL;
+  ctx->container_pool_size = 0;
+  free(ctx->root_list.items);
+  ctx->root_list.items = NULL;
+  ctx->root_list.capacity = 0;
+  free(ctx->command_list.items);
+  ctx->command_list.items = NULL;
+  ctx->command_list.capacity = 0;
+  free(ctx->draw_list.rects);
+  free(ctx->draw_list.texts);
+  free(ctx->draw_list.strings);
+  free(ctx->draw_list.batches);
+  memset(&ctx->draw_list, 0, sizeof(ctx->draw_list));
+}
+
+
 void mu_begin(mu_Context *ctx) {
   expect(ctx->text_width && ctx->text_height);
   ctx->command_list.idx = 0;
@@ -148,13 +186,93 @@ void mu_begin(mu_Context *ctx) {
 }
 
 
-static int compare_zindex(const void *a, const void *b) {
-  return (*(mu_Container**) a)->zindex - (*(mu_Container**) b)->zindex;
+/* grow `array` so that it holds at least `needed` items */
+#define reserve(array, capacity, needed) do {                        \
+    if ((needed) > (capacity)) {                                     \
+      int n = (capacity) ? (capacity) : 64;                          \
+      while (n < (needed)) { n *= 2; }                               \
+      (array) = realloc((array), n * sizeof(*(array)));              \
+      expect(array);                                                 \
+      (capacity) = n;                                                \
+    }                                                                \
+  } while (0)
+
+
+static void close_batch(mu_DrawList *list) {
+  mu_DrawBatch *batch;
+  reserve(list->batches, list->batches_capacity, list->nr_batches + 1);
+  batch = &list->batches[list->nr_batches++];
+  batch->rects_end = list->nr_rects;
+  batch->texts_end = list->nr_texts;
+}
+
+
+static void flatten_rect(mu_DrawList *list, mu_Rect rect, mu_Color color,
+  int icon)
+{
+  mu_RectDraw *draw;
+  /* painting this over text already in the batch needs a new batch */
+  int i = list->nr_batches ? list->batches[list->nr_batches - 1].texts_end : 0;
+  for (; i < list->nr_texts; i++) {
+    if (rects_overlap(rect, list->texts[i].bounds)) {
+      close_batch(list);
+      break;
+    }
+  }
+  reserve(list->rects, list->rects_capacity, list->nr_rects + 1);
+  draw = &list->rects[list->nr_rects++];
+  draw->rect = rect;
+  draw->color = color;
+  draw->icon = icon;
+}
+
+
+static void flatten_text(mu_DrawList *list, mu_TextCommand *cmd,
+  int text_height)
+{
+  mu_TextDraw *draw;
+  int len = strlen(cmd->str) + 1;
+  reserve(list->strings, list->strings_capacity, list->strings_size + len);
+  memcpy(list->strings + list->strings_size, cmd->str, len);
+  reserve(list->texts, list->texts_capacity, list->nr_texts + 1);
+  draw = &list->texts[list->nr_texts++];
+  draw->pos = cmd->pos;
+  draw->color = cmd->color;
+  draw->font = cmd->font;
+  draw->str = list->strings_size;
+  draw->bounds = mu_rect(cmd->pos.x - text_height, cmd->pos.y - text_height,
+    cmd->width + 2 * text_height, 3 * text_height);
+  list->strings_size += len;
+}
+
+
+/* commands of a root container lie between its head and tail, apart from
+** those of root containers begun inside it, which its jumps skip */
+static void flatten_container(mu_Context *ctx, mu_Container *cnt,
+  int text_height)
+{
+  mu_DrawList *list = &ctx->draw_list;
+  int offset = cnt->head + command_at(ctx, cnt->head)->base.size;
+  while (offset < cnt->tail) {
+    mu_Command *cmd = command_at(ctx, offset);
+    switch (cmd->type) {
+      case MU_COMMAND_JUMP: offset = cmd->jump.dst; continue;
+      case MU_COMMAND_RECT:
+        flatten_rect(list, cmd->rect.rect, cmd->rect.color, 0);
+        break;
+      case MU_COMMAND_ICON:
+        flatten_rect(list, cmd->icon.rect, cmd->icon.color, cmd->icon.id);
+        break;
+      case MU_COMMAND_TEXT: flatten_text(list, &cmd->text, text_height); break;
+    }
+    offset += cmd->base.size;
+  }
 }
 
 
 void mu_end(mu_Context *ctx) {
-  int i, n;
+  int i, n, first, text_height;
+  mu_Container *cnt;
   /* check stacks */
   expect(ctx->container_stack.idx == 0);
   expect(ctx->clip_stack.idx      == 0);
@@ -186,27 +304,46 @@ void mu_end(mu_Context *ctx) {
   ctx->scroll_delta = mu_vec2(0, 0);
   ctx->last_mouse_pos = ctx->mouse_pos;
 
-  /* sort root containers by zindex */
-  n = ctx->root_list.idx;
-  qsort(ctx->root_list.items, n, sizeof(mu_Container*), compare_zindex);
+  if (ctx->command_stats) {
+    ctx->command_stats(ctx, ctx->command_list.idx);
+  }
+
+  /* list root containers by zindex; containers are kept in z-order as they
+  ** are brought to front, so this only picks out those used this frame */
+  n = 0;
+  for (cnt = ctx->z_bottom; cnt; cnt = cnt->above) {
+    if (cnt->root_frame == ctx->frame) { ctx->root_list.items[n++] = cnt; }
+  }
+  ctx->root_list.idx = n;
 
   /* set root container jump commands */
   for (i = 0; i < n; i++) {
-    mu_Container *cnt = ctx->root_list.items[i];
+    cnt = ctx->root_list.items[i];
     /* if this is the first container then make the first command jump to it.
     ** otherwise set the previous container's tail to jump to this one */
+    first = cnt->head + command_at(ctx, cnt->head)->base.size;
     if (i == 0) {
-      mu_Command *cmd = (mu_Command*) ctx->command_list.items;
-      cmd->jump.dst = (char*) cnt->head + sizeof(mu_JumpCommand);
+      command_at(ctx, 0)->jump.dst = first;
     } else {
       mu_Container *prev = ctx->root_list.items[i - 1];
-      prev->tail->jump.dst = (char*) cnt->head + sizeof(mu_JumpCommand);
+      command_at(ctx, prev->tail)->jump.dst = first;
     }
     /* make the last container's tail jump to the end of command list */
     if (i == n - 1) {
-      cnt->tail->jump.dst = ctx->command_list.items + ctx->command_list.idx;
+      command_at(ctx, cnt->tail)->jump.dst = ctx->command_list.idx;
     }
   }
+
+  /* flatten the command list into the draw list */
+  ctx->draw_list.nr_rects = 0;
+  ctx->draw_list.nr_texts = 0;
+  ctx->draw_list.strings_size = 0;
+  ctx->draw_list.nr_batches = 0;
+  text_height = n ? ctx->text_height(ctx->style->font) : 0;
+  for (i = 0; i < n; i++) {
+    flatten_container(ctx, ctx->root_list.items[i], text_height);
+  }
+  close_batch(&ctx->draw_list);
 }
 
 
@@ -307,21 +444,60 @@ mu_Container* mu_get_current_container(mu_Context *ctx) {
 }
 
 
+static void z_unlink(mu_Context *ctx, mu_Container *cnt) {
+  if (cnt->below) { cnt->below->above = cnt->above; }
+  else if (ctx->z_bottom == cnt) { ctx->z_bottom = cnt->above; }
+  else { return; /* not listed */ }
+  if (cnt->above) { cnt->above->below = cnt->below; }
+  else { ctx->z_top = cnt->below; }
+  cnt->below = cnt->above = NULL;
+}
+
+
+/* whether a container was left unused for a frame, and may be reused */
+static int has_stale_container(mu_Context *ctx) {
+  int i;
+  for (i = 0; i < ctx->container_pool_size; i++) {
+    if (ctx->container_pool[i].last_update < ctx->frame) { return 1; }
+  }
+  return 0;
+}
+
+
+/* double the pool; the new containers are one block, so none ever moves */
+static void grow_container_pool(mu_Context *ctx) {
+  int i, old = ctx->container_pool_size;
+  int n = old ? old * 2 : MU_CONTAINERPOOL_SIZE;
+  mu_Container *block = calloc(n - old, sizeof(*block));
+  ctx->container_pool = realloc(ctx->container_pool,
+    n * sizeof(*ctx->container_pool));
+  ctx->containers = realloc(ctx->containers, n * sizeof(*ctx->containers));
+  expect(block && ctx->container_pool && ctx->containers);
+  memset(ctx->container_pool + old, 0,
+    (n - old) * sizeof(*ctx->container_pool));
+  for (i = old; i < n; i++) { ctx->containers[i] = &block[i - old]; }
+  ctx->container_pool_size = n;
+}
+
+
 static mu_Container* get_container(mu_Context *ctx, mu_Id id, int opt) {
   mu_Container *cnt;
   /* try to get existing container from pool */
-  int idx = mu_pool_get(ctx, ctx->container_pool, MU_CONTAINERPOOL_SIZE, id);
+  int idx = mu_pool_get(ctx, ctx->container_pool, ctx->container_pool_size, id);
   if (idx >= 0) {
-    if (ctx->containers[idx].open || ~opt & MU_OPT_CLOSED) {
+    if (ctx->containers[idx]->open || ~opt & MU_OPT_CLOSED) {
       mu_pool_update(ctx, ctx->container_pool, idx);
     }
-    return &ctx->containers[idx];
+    return ctx->containers[idx];
   }
   if (opt & MU_OPT_CLOSED) { return NULL; }
   /* container not found in pool: init new container */
-  idx = mu_pool_init(ctx, ctx->container_pool, MU_CONTAINERPOOL_SIZE, id);
-  cnt = &ctx->containers[idx];
+  if (!has_stale_container(ctx)) { grow_container_pool(ctx); }
+  idx = mu_pool_init(ctx, ctx->container_pool, ctx->container_pool_size, id);
+  cnt = ctx->containers[idx];
+  z_unlink(ctx, cnt);
   memset(cnt, 0, sizeof(*cnt));
+  cnt->head = cnt->tail = -1;
   cnt->open = 1;
   mu_bring_to_front(ctx, cnt);
   return cnt;
@@ -336,6 +512,11 @@ mu_Container* mu_get_container(mu_Context *ctx, const char *name) {
 
 void mu_bring_to_front(mu_Context *ctx, mu_Container *cnt) {
   cnt->zindex = ++ctx->last_zindex;
+  z_unlink(ctx, cnt);
+  cnt->below = ctx->z_top;
+  if (ctx->z_top) { ctx->z_top->above = cnt; }
+  else { ctx->z_bottom = cnt; }
+  ctx->z_top = cnt;
 }
 
 
@@ -424,9 +605,26 @@ void mu_input_text(mu_Context *ctx, const char *text) {
 ** commandlist
 **============================================================================*/
 
+/* the list only ever grows, so after the first few frames it stays put;
+** commands refer to each other by offset so that it may move meanwhile */
+static void grow_command_list(mu_Context *ctx, int needed) {
+  int capacity = ctx->command_list.capacity;
+  if (!capacity) { capacity = MU_COMMANDLIST_SIZE; }
+  while (capacity < needed) { capacity *= 2; }
+  ctx->command_list.items = realloc(ctx->command_list.items, capacity);
+  expect(ctx->command_list.items);
+  ctx->command_list.capacity = capacity;
+}
+
+
 mu_Command* mu_push_command(mu_Context *ctx, int type, int size) {
-  mu_Command *cmd = (mu_Command*) (ctx->command_list.items + ctx->command_list.idx);
-  expect(ctx->command_list.idx + size < MU_COMMANDLIST_SIZE);
+  mu_Command *cmd;
+  size = (size + COMMAND_ALIGN - 1) & ~(COMMAND_ALIGN - 1);
+  expect(size <= MAX_COMMAND_SIZE);
+  if (ctx->command_list.idx + size > ctx->command_list.capacity) {
+    grow_command_list(ctx, ctx->command_list.idx + size);
+  }
+  cmd = command_at(ctx, ctx->command_list.idx);
   cmd->base.type = type;
   cmd->base.size = size;
   ctx->command_list.idx += size;
@@ -442,17 +640,19 @@ int mu_next_command(mu_Context *ctx, mu_Command **cmd) {
   }
   while ((char*) *cmd != ctx->command_list.items + ctx->command_list.idx) {
     if ((*cmd)->type != MU_COMMAND_JUMP) { return 1; }
-    *cmd = (*cmd)->jump.dst;
+    *cmd = command_at(ctx, (*cmd)->jump.dst);
   }
   return 0;
 }
 
 
-static mu_Command* push_jump(mu_Context *ctx, mu_Command *dst) {
+/* returns the offset of the jump command */
+static int push_jump(mu_Context *ctx, int dst) {
+  int offset = ctx->command_list.idx;
   mu_Command *cmd;
   cmd = mu_push_command(ctx, MU_COMMAND_JUMP, sizeof(mu_JumpCommand));
   cmd->jump.dst = dst;
-  return cmd;
+  return offset;
 }
 
 
@@ -493,12 +693,14 @@ void mu_draw_text(mu_Context *ctx, mu_Font font, const char *str, int len,
   if (clipped == MU_CLIP_PART) { mu_set_clip(ctx, mu_get_clip_rect(ctx)); }
   /* add command */
   if (len < 0) { len = strlen(str); }
+  len = mu_min(len, MAX_COMMAND_SIZE - (int) (sizeof(mu_TextCommand) + COMMAND_ALIGN));
   cmd = mu_push_command(ctx, MU_COMMAND_TEXT, sizeof(mu_TextCommand) + len);
   memcpy(cmd->text.str, str, len);
   cmd->text.str[len] = '\0';
   cmd->text.pos = pos;
   cmd->text.color = color;
   cmd->text.font = font;
+  cmd->text.width = rect.w;
   /* reset clipping if it was set */
   if (clipped) { mu_set_clip(ctx, unclipped_rect); }
 }
@@ -634,7 +836,7 @@ static int in_hover_root(mu_Context *ctx) {
     if (ctx->container_stack.items[i] == ctx->hover_root) { return 1; }
     /* only root containers have their `head` field set; stop searching if we've
     ** reached the current root container */
-    if (ctx->container_stack.items[i]->head) { break; }
+    if (ctx->container_stack.items[i]->head >= 0) { break; }
   }
   return 0;
 }
@@ -1052,8 +1254,11 @@ static void push_container_body(
 static void begin_root_container(mu_Context *ctx, mu_Container *cnt) {
   push(ctx->container_stack, cnt);
   /* push container to roots list and push head command */
-  push(ctx->root_list, cnt);
-  cnt->head = push_jump(ctx, NULL);
+  reserve(ctx->root_list.items, ctx->root_list.capacity,
+    ctx->root_list.idx + 1);
+  ctx->root_list.items[ctx->root_list.idx++] = cnt;
+  cnt->root_frame = ctx->frame;
+  cnt->head = push_jump(ctx, 0);
   /* set as hover root if the mouse is overlapping this container and it has a
   ** higher zindex than the current hover root */
   if (rect_overlaps_vec2(cnt->rect, ctx->mouse_pos) &&
@@ -1072,8 +1277,8 @@ static void end_root_container(mu_Context *ctx) {
   /* push tail 'goto' jump command and set head 'skip' command. the final steps
   ** on initing these are done in mu_end() */
   mu_Container *cnt = mu_get_current_container(ctx);
-  cnt->tail = push_jump(ctx, NULL);
-  cnt->head->jump.dst = ctx->command_list.items + ctx->command_list.idx;
+  cnt->tail = push_jump(ctx, 0);
+  command_at(ctx, cnt->head)->jump.dst = ctx->command_list.idx;
   /* pop base clip rect and container */
   mu_pop_clip_rect(ctx);
   pop_container(ctx);
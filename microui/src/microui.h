@@ -10,8 +10,7 @@
 
 #define MU_VERSION "2.01"
 
-#define MU_COMMANDLIST_SIZE     (256 * 1024)
-#define MU_ROOTLIST_SIZE        32
+#define MU_COMMANDLIST_SIZE     (16 * 1024)
 #define MU_CONTAINERSTACK_SIZE  32
 #define MU_CLIPSTACK_SIZE       32
 #define MU_IDSTACK_SIZE         32
@@ -116,15 +115,15 @@ typedef struct { int x, y, w, h; } mu_Rect;
 typedef struct { unsigned char r, g, b, a; } mu_Color;
 typedef struct { mu_Id id; int last_update; } mu_PoolItem;
 
-typedef struct { int type, size; } mu_BaseCommand;
-typedef struct { mu_BaseCommand base; void *dst; } mu_JumpCommand;
+typedef struct { unsigned short type, size; } mu_BaseCommand;
+typedef struct { mu_BaseCommand base; int dst; } mu_JumpCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; } mu_ClipCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; mu_Color color; } mu_RectCommand;
-typedef struct { mu_BaseCommand base; mu_Font font; mu_Vec2 pos; mu_Color color; char str[1]; } mu_TextCommand;
+typedef struct { mu_BaseCommand base; mu_Font font; mu_Vec2 pos; mu_Color color; int width; char str[1]; } mu_TextCommand;
 typedef struct { mu_BaseCommand base; mu_Rect rect; int id; mu_Color color; } mu_IconCommand;
 
 typedef union {
-  int type;
+  unsigned short type;
   mu_BaseCommand base;
   mu_JumpCommand jump;
   mu_ClipCommand clip;
@@ -133,6 +132,28 @@ typedef union {
   mu_IconCommand icon;
 } mu_Command;
 
+/* flattened output of a frame, built by mu_end(): the rect and text commands
+** of all root containers in z-order, as separate arrays of fixed-size items.
+** each batch draws its rects and then its texts, starting where the previous
+** batch ended; batches only break where a rect would cover text of its own
+** batch, so this paints the same as the command list. `bounds` is all a text
+** may paint, allowing for ink overhanging its line by a line height */
+typedef struct { mu_Rect rect; mu_Color color; int icon; } mu_RectDraw;
+typedef struct { mu_Vec2 pos; mu_Color color; mu_Font font; int str; mu_Rect bounds; } mu_TextDraw;
+typedef struct { int rects_end, texts_end; } mu_DrawBatch;
+
+typedef struct {
+  mu_RectDraw *rects;
+  int nr_rects, rects_capacity;
+  mu_TextDraw *texts;
+  int nr_texts, texts_capacity;
+  /* nul-terminated strings of the texts, at their `str` offsets */
+  char *strings;
+  int strings_size, strings_capacity;
+  mu_DrawBatch *batches;
+  int nr_batches, batches_capacity;
+} mu_DrawList;
+
 typedef struct {
   mu_Rect body;
   mu_Rect next;
@@ -147,14 +168,17 @@ typedef struct {
   int indent;
 } mu_Layout;
 
-typedef struct {
-  mu_Command *head, *tail;
+typedef struct mu_Container {
+  int head, tail;
   mu_Rect rect;
   mu_Rect body;
   mu_Vec2 content_size;
   mu_Vec2 scroll;
   int zindex;
   int open;
+  /* neighbours in z-order, and the last frame this was a root container */
+  struct mu_Container *below, *above;
+  int root_frame;
 } mu_Container;
 
 typedef struct {
@@ -174,6 +198,7 @@ struct mu_Context {
   int (*text_width)(mu_Font font, const char *str, int len);
   int (*text_height)(mu_Font font);
   void (*draw_frame)(mu_Context *ctx, mu_Rect rect, int colorid);
+  void (*command_stats)(mu_Context *ctx, int bytes);
   /* core state */
   mu_Style _style;
   mu_Style *style;
@@ -187,18 +212,22 @@ struct mu_Context {
   mu_Container *hover_root;
   mu_Container *next_hover_root;
   mu_Container *scroll_target;
+  mu_Container *z_bottom, *z_top;
   char number_edit_buf[MU_MAX_FMT];
   mu_Id number_edit;
   /* stacks */
-  mu_stack(char, MU_COMMANDLIST_SIZE) command_list;
-  mu_stack(mu_Container*, MU_ROOTLIST_SIZE) root_list;
+  struct { int idx, capacity; char *items; } command_list;
+  mu_DrawList draw_list;
+  struct { int idx, capacity; mu_Container **items; } root_list;
   mu_stack(mu_Container*, MU_CONTAINERSTACK_SIZE) container_stack;
   mu_stack(mu_Rect, MU_CLIPSTACK_SIZE) clip_stack;
   mu_stack(mu_Id, MU_IDSTACK_SIZE) id_stack;
   mu_stack(mu_Layout, MU_LAYOUTSTACK_SIZE) layout_stack;
-  /* retained state pools */
-  mu_PoolItem container_pool[MU_CONTAINERPOOL_SIZE];
-  mu_Container containers[MU_CONTAINERPOOL_SIZE];
+  /* retained state pools; the container pool grows as needed, keeping
+  ** containers where they are since they are referred to by pointer */
+  int container_pool_size;
+  mu_PoolItem *container_pool;
+  mu_Container **containers;
   mu_PoolItem treenode_pool[MU_TREENODEPOOL_SIZE];
   /* input state */
   mu_Vec2 mouse_pos;
@@ -218,6 +247,7 @@ mu_Rect mu_rect(int x, int y, int w, int h);
 mu_Color mu_color(int r, int g, int b, int a);
 
 void mu_init(mu_Context *ctx);
+void mu_finish(mu_Context *ctx);
 void mu_begin(mu_Context *ctx);
 void mu_end(mu_Context *ctx);
 void mu_set_focus(mu_Context *ctx, mu_Id id);
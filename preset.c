@@ -0,0 +1,601 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include "preset.h"
+#include "region.h"
+#include "settings.h"
+#include "util.h"
+
+/* Bump when the built-in presets or the cache format change */
+#define CACHE_VERSION 1
+#define CACHE_MAGIC "LRPC"
+
+/* Most cells a grid preset may have */
+#define GRID_MAX_CELLS 64
+
+/* 100% in fixed-point */
+#define PERCENT_FULL (100 * FIXED_ONE)
+
+/* Geometry in percent, in fixed-point */
+struct preset_box {
+	int32_t x, y, width, height;
+};
+
+/*
+ * The cache file is a header, the presets, all their boxes, and then their
+ * NUL-terminated names. It is only read by the machine that wrote it, so
+ * everything is in native byte order.
+ */
+struct cache_header {
+	char magic[4];
+	uint32_t version;
+	/* The user's file the cache was built from, all zero if none */
+	int64_t source_sec, source_nsec, source_size;
+	uint32_t nr_presets, nr_boxes, strings_size;
+	uint32_t reserved;
+};
+
+struct cache_preset {
+	uint32_t name, first_box, nr_boxes;
+};
+
+struct preset_library {
+	void *data;
+	size_t size;
+	bool mapped;
+
+	const struct cache_header *header;
+	const struct cache_preset *presets;
+	const struct preset_box *boxes;
+	const char *strings;
+};
+
+/* Built-in presets. Thirds are 33.3333% and 33.3334% in the middle. */
+#define PC(percent) ((percent) * FIXED_ONE)
+#define THIRD 333333
+#define TWO_THIRDS 666667
+
+static const struct builtin {
+	const char *name;
+	int nr_boxes;
+	struct preset_box boxes[4];
+} builtins[] = {
+	{ "halves", 2, {
+		{ 0, 0, PC(50), PC(100) },
+		{ PC(50), 0, PC(50), PC(100) },
+	} },
+	{ "halves-stacked", 2, {
+		{ 0, 0, PC(100), PC(50) },
+		{ 0, PC(50), PC(100), PC(50) },
+	} },
+	{ "thirds", 3, {
+		{ 0, 0, THIRD, PC(100) },
+		{ THIRD, 0, TWO_THIRDS - THIRD, PC(100) },
+		{ TWO_THIRDS, 0, PC(100) - TWO_THIRDS, PC(100) },
+	} },
+	{ "two-thirds-left", 2, {
+		{ 0, 0, TWO_THIRDS, PC(100) },
+		{ TWO_THIRDS, 0, PC(100) - TWO_THIRDS, PC(100) },
+	} },
+	{ "two-thirds-right", 2, {
+		{ 0, 0, THIRD, PC(100) },
+		{ THIRD, 0, PC(100) - THIRD, PC(100) },
+	} },
+	{ "quarters", 4, {
+		{ 0, 0, PC(50), PC(50) },
+		{ PC(50), 0, PC(50), PC(50) },
+		{ 0, PC(50), PC(50), PC(50) },
+		{ PC(50), PC(50), PC(50), PC(50) },
+	} },
+	{ "ultrawide-focus", 3, {
+		{ 0, 0, PC(25), PC(100) },
+		{ PC(25), 0, PC(50), PC(100) },
+		{ PC(75), 0, PC(25), PC(100) },
+	} },
+	{ "ultrawide-sidebars", 3, {
+		{ 0, 0, PC(20), PC(100) },
+		{ PC(20), 0, PC(60), PC(100) },
+		{ PC(80), 0, PC(20), PC(100) },
+	} },
+	{ "ultrawide-quarters", 4, {
+		{ 0, 0, PC(25), PC(100) },
+		{ PC(25), 0, PC(25), PC(100) },
+		{ PC(50), 0, PC(25), PC(100) },
+		{ PC(75), 0, PC(25), PC(100) },
+	} },
+};
+
+/* Presets, boxes and names as they are collected for a new cache */
+struct builder {
+	struct cache_preset *presets;
+	int nr_presets, presets_capacity;
+	struct preset_box *boxes;
+	int nr_boxes, boxes_capacity;
+	char *strings;
+	size_t strings_size, strings_capacity;
+};
+
+static void
+builder_finish(struct builder *builder)
+{
+	free(builder->presets);
+	free(builder->boxes);
+	free(builder->strings);
+}
+
+static bool
+builder_has(struct builder *builder, const char *name)
+{
+	for (int i = 0; i < builder->nr_presets; i++) {
+		if (!strcmp(builder->strings + builder->presets[i].name, name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+builder_begin(struct builder *builder, const char *name)
+{
+	if (builder->nr_presets == builder->presets_capacity) {
+		builder->presets_capacity = builder->presets_capacity
+			? builder->presets_capacity * 2 : 16;
+		builder->presets = realloc(builder->presets,
+			builder->presets_capacity * sizeof(*builder->presets));
+	}
+	size_t len = strlen(name) + 1;
+	while (builder->strings_size + len > builder->strings_capacity) {
+		builder->strings_capacity = builder->strings_capacity
+			? builder->strings_capacity * 2 : 256;
+		builder->strings = realloc(builder->strings,
+			builder->strings_capacity);
+	}
+	memcpy(builder->strings + builder->strings_size, name, len);
+
+	builder->presets[builder->nr_presets++] = (struct cache_preset){
+		.name = builder->strings_size,
+		.first_box = builder->nr_boxes,
+	};
+	builder->strings_size += len;
+}
+
+static void
+builder_add_box(struct builder *builder, const struct preset_box *box)
+{
+	if (builder->nr_boxes == builder->boxes_capacity) {
+		builder->boxes_capacity = builder->boxes_capacity
+			? builder->boxes_capacity * 2 : 64;
+		builder->boxes = realloc(builder->boxes,
+			builder->boxes_capacity * sizeof(*builder->boxes));
+	}
+	builder->boxes[builder->nr_boxes++] = *box;
+	builder->presets[builder->nr_presets - 1].nr_boxes++;
+}
+
+/* Take back the preset begun last, keeping its name unused */
+static void
+builder_cancel(struct builder *builder)
+{
+	struct cache_preset *preset =
+		&builder->presets[--builder->nr_presets];
+	builder->nr_boxes = preset->first_box;
+}
+
+/* Percent as fixed-point. The '%' may be left out. */
+static bool
+parse_percent(xmlNode *node, const char *attr, int32_t *value)
+{
+	char *s = (char *)xmlGetProp(node, (const xmlChar *)attr);
+	if (!s) {
+		return false;
+	}
+	char *end;
+	double percent = strtod(s, &end);
+	bool ok = end != s && (!*end || !strcmp(end, "%"))
+		&& percent >= -1000 && percent <= 1000;
+	*value = (int32_t)(percent * FIXED_ONE + (percent < 0 ? -0.5 : 0.5));
+	xmlFree(s);
+	return ok;
+}
+
+static void
+load_user_presets(struct builder *builder, const char *filename)
+{
+	xmlDoc *doc = xmlReadFile(filename, NULL, XML_PARSE_NOBLANKS);
+	if (!doc) {
+		LOG(LOG_ERROR, "error parsing presets file (%s)", filename);
+		return;
+	}
+	xmlNode *root = xmlDocGetRootElement(doc);
+	for (xmlNode *n = root ? root->children : NULL; n; n = n->next) {
+		if (n->type != XML_ELEMENT_NODE
+				|| strcmp((char *)n->name, "preset")) {
+			continue;
+		}
+		char *name = (char *)xmlGetProp(n, (const xmlChar *)"name");
+		if (!name || !*name || builder_has(builder, name)) {
+			LOG(LOG_ERROR, "preset without a unique name");
+			xmlFree(name);
+			continue;
+		}
+		builder_begin(builder, name);
+
+		bool ok = true;
+		for (xmlNode *r = n->children; r && ok; r = r->next) {
+			if (r->type != XML_ELEMENT_NODE
+					|| strcmp((char *)r->name, "region")) {
+				continue;
+			}
+			struct preset_box box;
+			ok = parse_percent(r, "x", &box.x)
+				&& parse_percent(r, "y", &box.y)
+				&& parse_percent(r, "width", &box.width)
+				&& parse_percent(r, "height", &box.height);
+			if (ok) {
+				builder_add_box(builder, &box);
+			}
+		}
+		if (!ok || !builder->presets[builder->nr_presets - 1].nr_boxes) {
+			LOG(LOG_ERROR, "preset '%s' needs regions with x, y, "
+				"width and height", name);
+			builder_cancel(builder);
+		}
+		xmlFree(name);
+	}
+	xmlFreeDoc(doc);
+}
+
+/* Point the library at the sections of its data, if they make sense */
+static bool
+library_check(struct preset_library *library,
+		const struct cache_header *source)
+{
+	const struct cache_header *header = library->data;
+	if (library->size < sizeof(*header)
+			|| memcmp(header->magic, CACHE_MAGIC, 4)
+			|| header->version != CACHE_VERSION
+			|| header->source_sec != source->source_sec
+			|| header->source_nsec != source->source_nsec
+			|| header->source_size != source->source_size) {
+		return false;
+	}
+	uint64_t size = sizeof(*header)
+		+ (uint64_t)header->nr_presets * sizeof(struct cache_preset)
+		+ (uint64_t)header->nr_boxes * sizeof(struct preset_box)
+		+ header->strings_size;
+	if (size != library->size) {
+		return false;
+	}
+
+	library->header = header;
+	library->presets = (const void *)(header + 1);
+	library->boxes = (const void *)(library->presets + header->nr_presets);
+	library->strings = (const char *)(library->boxes + header->nr_boxes);
+	if (header->strings_size
+			&& library->strings[header->strings_size - 1]) {
+		return false;
+	}
+	for (uint32_t i = 0; i < header->nr_presets; i++) {
+		const struct cache_preset *preset = &library->presets[i];
+		if (preset->name >= header->strings_size || !preset->nr_boxes
+				|| preset->first_box > header->nr_boxes
+				|| preset->nr_boxes
+					> header->nr_boxes - preset->first_box) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+map_cache(struct preset_library *library, const char *filename,
+		const struct cache_header *source)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	library->data = data;
+	library->size = st.st_size;
+	library->mapped = true;
+	if (!library_check(library, source)) {
+		munmap(data, st.st_size);
+		library->data = NULL;
+		library->mapped = false;
+		return false;
+	}
+	return true;
+}
+
+static void
+build_cache(struct preset_library *library, const char *user_filename,
+		const struct cache_header *source)
+{
+	struct builder builder = { 0 };
+	if (source->source_size) {
+		load_user_presets(&builder, user_filename);
+	}
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); i++) {
+		if (builder_has(&builder, builtins[i].name)) {
+			continue;
+		}
+		builder_begin(&builder, builtins[i].name);
+		for (int j = 0; j < builtins[i].nr_boxes; j++) {
+			builder_add_box(&builder, &builtins[i].boxes[j]);
+		}
+	}
+
+	struct cache_header header = *source;
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.nr_presets = builder.nr_presets;
+	header.nr_boxes = builder.nr_boxes;
+	header.strings_size = builder.strings_size;
+
+	size_t presets_size = builder.nr_presets * sizeof(struct cache_preset);
+	size_t boxes_size = builder.nr_boxes * sizeof(struct preset_box);
+	library->size = sizeof(header) + presets_size + boxes_size
+		+ builder.strings_size;
+	library->data = malloc(library->size);
+	char *p = library->data;
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+	memcpy(p, builder.presets, presets_size);
+	p += presets_size;
+	memcpy(p, builder.boxes, boxes_size);
+	p += boxes_size;
+	memcpy(p, builder.strings, builder.strings_size);
+	builder_finish(&builder);
+
+	library_check(library, source);
+}
+
+/* Create the directories leading up to @filename */
+static void
+make_parents(char *filename)
+{
+	for (char *p = strchr(filename + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if (mkdir(filename, 0755) && errno != EEXIST) {
+			*p = '/';
+			return;
+		}
+		*p = '/';
+	}
+}
+
+/* Write the cache out under a temporary name, so readers never see half */
+static void
+write_cache(struct preset_library *library, char *filename)
+{
+	make_parents(filename);
+	char tmp[4096 + 8];
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", filename);
+	int fd = mkstemp(tmp);
+	if (fd < 0) {
+		LOG_ERRNO(LOG_ERROR, "cannot write preset cache (%s)", filename);
+		return;
+	}
+	const char *p = library->data;
+	size_t left = library->size;
+	while (left) {
+		ssize_t n = write(fd, p, left);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			LOG_ERRNO(LOG_ERROR, "cannot write preset cache (%s)",
+				filename);
+			close(fd);
+			unlink(tmp);
+			return;
+		}
+		p += n;
+		left -= n;
+	}
+	close(fd);
+	if (rename(tmp, filename)) {
+		unlink(tmp);
+	}
+}
+
+/* $<env>/<file>, or $HOME/<fallback>/<file> if $<env> is not set */
+static bool
+xdg_path(char *buf, size_t len, const char *env, const char *fallback,
+		const char *file)
+{
+	const char *base = getenv(env);
+	int n;
+	if (base && *base == '/') {
+		n = snprintf(buf, len, "%s/%s", base, file);
+	} else if (getenv("HOME")) {
+		n = snprintf(buf, len, "%s/%s/%s", getenv("HOME"), fallback,
+			file);
+	} else {
+		return false;
+	}
+	return n > 0 && (size_t)n < len;
+}
+
+struct preset_library *
+preset_library_open(void)
+{
+	struct preset_library *library = calloc(1, sizeof(*library));
+	char user_filename[4096];
+	char cache_filename[4096];
+
+	struct cache_header source = { 0 };
+	struct stat st;
+	if (xdg_path(user_filename, sizeof(user_filename), "XDG_CONFIG_HOME",
+			".config", "labwc/region-presets.xml")
+			&& !stat(user_filename, &st) && st.st_size > 0) {
+		source.source_sec = st.st_mtim.tv_sec;
+		source.source_nsec = st.st_mtim.tv_nsec;
+		source.source_size = st.st_size;
+	}
+
+	bool have_cache = xdg_path(cache_filename, sizeof(cache_filename),
+		"XDG_CACHE_HOME", ".cache", "labwc-regions/presets.bin");
+	if (have_cache && map_cache(library, cache_filename, &source)) {
+		return library;
+	}
+	build_cache(library, user_filename, &source);
+	if (have_cache) {
+		write_cache(library, cache_filename);
+	}
+	return library;
+}
+
+void
+preset_library_close(struct preset_library *library)
+{
+	if (!library) {
+		return;
+	}
+	if (library->mapped) {
+		munmap(library->data, library->size);
+	} else {
+		free(library->data);
+	}
+	free(library);
+}
+
+int
+preset_count(struct preset_library *library)
+{
+	return library->header->nr_presets;
+}
+
+const char *
+preset_name(struct preset_library *library, int index)
+{
+	return library->strings + library->presets[index].name;
+}
+
+static int
+preset_find(struct preset_library *library, const char *name)
+{
+	for (int i = 0; i < preset_count(library); i++) {
+		if (!strcmp(preset_name(library, i), name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool
+parse_grid(const char *name, int *columns, int *rows)
+{
+	char tail;
+	*columns = *rows = 1;
+	if (sscanf(name, "columns-%d%c", columns, &tail) != 1
+			&& sscanf(name, "rows-%d%c", rows, &tail) != 1
+			&& sscanf(name, "grid-%dx%d%c", columns, rows, &tail) != 2) {
+		return false;
+	}
+	return *columns > 0 && *rows > 0
+		&& *columns <= GRID_MAX_CELLS / *rows;
+}
+
+/* Fill @boxes with the cells of an even grid, row by row */
+static void
+grid_boxes(struct preset_box *boxes, int columns, int rows)
+{
+	for (int i = 0; i < columns * rows; i++) {
+		int column = i % columns;
+		int row = i / columns;
+		int32_t x = (int64_t)PERCENT_FULL * column / columns;
+		int32_t y = (int64_t)PERCENT_FULL * row / rows;
+		boxes[i] = (struct preset_box){
+			.x = x,
+			.y = y,
+			.width = (int64_t)PERCENT_FULL * (column + 1) / columns - x,
+			.height = (int64_t)PERCENT_FULL * (row + 1) / rows - y,
+		};
+	}
+}
+
+bool
+preset_exists(struct preset_library *library, const char *name)
+{
+	int columns, rows;
+	return preset_find(library, name) >= 0
+		|| parse_grid(name, &columns, &rows);
+}
+
+bool
+preset_apply(struct preset_library *library, const char *name,
+		struct region_table *table, double width, double height)
+{
+	struct preset_box grid[GRID_MAX_CELLS];
+	const struct preset_box *boxes = grid;
+	int nr_boxes, columns, rows;
+
+	int index = preset_find(library, name);
+	if (index >= 0) {
+		boxes = library->boxes + library->presets[index].first_box;
+		nr_boxes = library->presets[index].nr_boxes;
+	} else if (parse_grid(name, &columns, &rows)) {
+		grid_boxes(grid, columns, rows);
+		nr_boxes = columns * rows;
+	} else {
+		return false;
+	}
+
+	int nr = 0;
+	region_for_each(table, id) {
+		nr++;
+	}
+	if (!nr) {
+		return false;
+	}
+
+	int *ids = calloc(nr > nr_boxes ? nr : nr_boxes, sizeof(int));
+	nr = 0;
+	region_for_each(table, id) {
+		if (nr == nr_boxes) {
+			settings_region_remove(id);
+			continue;
+		}
+		ids[nr++] = id;
+	}
+	for (; nr < nr_boxes; nr++) {
+		ids[nr] = settings_region_add(ids[nr - 1]);
+	}
+
+	/*
+	 * Set the geometry as it would read in the config, so that it saves
+	 * exactly, and work out the pixels from that like on startup
+	 */
+	for (int i = 0; i < nr_boxes; i++) {
+		int id = ids[i];
+		table->fx[id] = boxes[i].x;
+		table->fy[id] = boxes[i].y;
+		table->fwidth[id] = boxes[i].width;
+		table->fheight[id] = boxes[i].height;
+		table->flags[id] |= REGION_PERCENT_X | REGION_PERCENT_Y
+			| REGION_PERCENT_WIDTH | REGION_PERCENT_HEIGHT;
+	}
+	free(ids);
+	convert_regions_from_percentage_to_pixels(width, height);
+	return true;
+}
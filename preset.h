@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef PRESET_H
+#define PRESET_H
+#include <stdbool.h>
+
+/*
+ * Named region layouts, in percent of the output. The built-in presets and
+ * any defined in labwc/region-presets.xml under $XDG_CONFIG_HOME are
+ * compiled into one file under $XDG_CACHE_HOME, which is mapped as it is on
+ * later runs. The cache is rebuilt when the user's file changes.
+ *
+ * The user's file lists presets like this, each with one or more regions:
+ *
+ *   <presets>
+ *     <preset name="focus">
+ *       <region x="20%" y="0%" width="60%" height="100%"/>
+ *     </preset>
+ *   </presets>
+ *
+ * Besides the named presets, "columns-<n>", "rows-<n>" and "grid-<c>x<r>"
+ * give even grids.
+ */
+struct preset_library;
+struct region_table;
+
+struct preset_library *preset_library_open(void);
+void preset_library_close(struct preset_library *library);
+
+/* Named presets, user-defined ones first */
+int preset_count(struct preset_library *library);
+const char *preset_name(struct preset_library *library, int index);
+
+bool preset_exists(struct preset_library *library, const char *name);
+
+/*
+ * Give the regions the boxes of preset @name in the order they are listed,
+ * adding or removing regions so that there is one per box, and work out
+ * their pixels for an output of @width x @height. Returns false, leaving the
+ * regions alone, if there is no such preset or no region to start from.
+ */
+bool preset_apply(struct preset_library *library, const char *name,
+	struct region_table *table, double width, double height);
+
+#endif /* PRESET_H */
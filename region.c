@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <string.h>
+#include "arena.h"
+#include "region.h"
+
+/*
+ * Interned strings. They are copied into the table's arena, so the pointers
+ * handed out stay valid until the table is finished, and are found again
+ * through an open addressing hash set.
+ *
+ * Each string sits behind a header naming the live region it belongs to, so
+ * a name finds its region, and a region's name its header, without a scan.
+ */
+struct interned {
+	/* Lowest live region of this name or -1, and how many there are */
+	int region, nr_regions;
+	char string[];
+};
+
+struct strings {
+	struct arena *arena;
+	struct interned **slots;
+	int nr_slots, nr_strings;
+};
+
+static struct interned *
+interned_of(const char *string)
+{
+	return (struct interned *)(string - offsetof(struct interned, string));
+}
+
+static uint32_t
+hash_string(const char *s)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+	for (; *s; s++) {
+		hash ^= (unsigned char)*s;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct interned **
+strings_slot(struct strings *strings, const char *s)
+{
+	uint32_t mask = strings->nr_slots - 1;
+	uint32_t i = hash_string(s) & mask;
+	while (strings->slots[i] && strcmp(strings->slots[i]->string, s)) {
+		i = (i + 1) & mask;
+	}
+	return &strings->slots[i];
+}
+
+static void
+strings_grow(struct strings *strings)
+{
+	struct interned **old = strings->slots;
+	int nr_old = strings->nr_slots;
+	strings->nr_slots = nr_old ? nr_old * 2 : 64;
+	strings->slots = arena_alloc(strings->arena,
+		strings->nr_slots * sizeof(struct interned *));
+	for (int i = 0; i < nr_old; i++) {
+		if (old[i]) {
+			*strings_slot(strings, old[i]->string) = old[i];
+		}
+	}
+}
+
+static struct interned *
+strings_intern(struct strings *strings, const char *s)
+{
+	if (2 * (strings->nr_strings + 1) > strings->nr_slots) {
+		strings_grow(strings);
+	}
+	struct interned **slot = strings_slot(strings, s);
+	if (!*slot) {
+		size_t len = strlen(s);
+		*slot = arena_alloc(strings->arena,
+			sizeof(struct interned) + len + 1);
+		(*slot)->region = -1;
+		memcpy((*slot)->string, s, len + 1);
+		strings->nr_strings++;
+	}
+	return *slot;
+}
+
+/* Return the interned copy of @s, or NULL if there is none */
+static struct interned *
+strings_lookup(struct strings *strings, const char *s)
+{
+	if (!strings->nr_slots) {
+		return NULL;
+	}
+	return *strings_slot(strings, s);
+}
+
+void
+region_table_init(struct region_table *table)
+{
+	memset(table, 0, sizeof(*table));
+	arena_init(&table->arena);
+	table->strings = arena_alloc(&table->arena, sizeof(struct strings));
+	table->strings->arena = &table->arena;
+}
+
+/* Everything is in the arena, so it goes in one call */
+void
+region_table_finish(struct region_table *table)
+{
+	arena_finish(&table->arena);
+	memset(table, 0, sizeof(*table));
+}
+
+/* The old column is left in the arena, which is at most as large again */
+#define GROW(table, column, capacity) do { \
+	void *grown = arena_alloc(&(table)->arena, \
+		(capacity) * sizeof(*(table)->column)); \
+	if ((table)->nr) { \
+		memcpy(grown, (table)->column, \
+			(table)->nr * sizeof(*(table)->column)); \
+	} \
+	(table)->column = grown; \
+} while (0)
+
+static void
+grow(struct region_table *table)
+{
+	int capacity = table->capacity ? table->capacity * 2 : 32;
+	GROW(table, x, capacity);
+	GROW(table, y, capacity);
+	GROW(table, width, capacity);
+	GROW(table, height, capacity);
+	GROW(table, fx, capacity);
+	GROW(table, fy, capacity);
+	GROW(table, fwidth, capacity);
+	GROW(table, fheight, capacity);
+	GROW(table, flags, capacity);
+	GROW(table, name, capacity);
+	GROW(table, node, capacity);
+	GROW(table, free_slots, capacity);
+	table->capacity = capacity;
+}
+
+static void
+clear_slot(struct region_table *table, int id)
+{
+	table->x[id] = 0;
+	table->y[id] = 0;
+	table->width[id] = 0;
+	table->height[id] = 0;
+	table->fx[id] = 0;
+	table->fy[id] = 0;
+	table->fwidth[id] = 0;
+	table->fheight[id] = 0;
+	table->flags[id] = 0;
+	table->name[id] = NULL;
+	table->node[id] = NULL;
+}
+
+/* Count @id among the regions of its name */
+static void
+name_attach(struct region_table *table, int id)
+{
+	struct interned *interned = interned_of(table->name[id]);
+	if (interned->region < 0 || id < interned->region) {
+		interned->region = id;
+	}
+	interned->nr_regions++;
+}
+
+static void
+name_detach(struct region_table *table, int id)
+{
+	struct interned *interned = interned_of(table->name[id]);
+	if (--interned->nr_regions == 0) {
+		interned->region = -1;
+		return;
+	}
+	if (interned->region != id) {
+		return;
+	}
+
+	/* Only a name shared by several regions comes here */
+	interned->region = -1;
+	region_for_each(table, other) {
+		if (other != id && table->name[other] == interned->string) {
+			interned->region = other;
+			break;
+		}
+	}
+}
+
+int
+region_add(struct region_table *table, const char *name, xmlNode *node)
+{
+	int id;
+	if (table->nr_free) {
+		id = table->free_slots[--table->nr_free];
+	} else {
+		if (table->nr == table->capacity) {
+			grow(table);
+		}
+		id = table->nr++;
+	}
+	clear_slot(table, id);
+	table->flags[id] = REGION_LIVE;
+	table->name[id] = strings_intern(table->strings, name)->string;
+	table->node[id] = node;
+	name_attach(table, id);
+	return id;
+}
+
+void
+region_remove(struct region_table *table, int id)
+{
+	name_detach(table, id);
+	clear_slot(table, id);
+	table->free_slots[table->nr_free++] = id;
+}
+
+void
+region_rename(struct region_table *table, int id, const char *name)
+{
+	name_detach(table, id);
+	table->name[id] = strings_intern(table->strings, name)->string;
+	name_attach(table, id);
+}
+
+int
+region_find(struct region_table *table, const char *name)
+{
+	struct interned *interned = strings_lookup(table->strings, name);
+	return interned ? interned->region : -1;
+}
+
+struct dbox
+region_box(const struct region_table *table, int id)
+{
+	return (struct dbox){
+		table->x[id], table->y[id], table->width[id], table->height[id],
+	};
+}
+
+void
+region_set_box(struct region_table *table, int id, const struct dbox *box)
+{
+	table->x[id] = box->x;
+	table->y[id] = box->y;
+	table->width[id] = box->width;
+	table->height[id] = box->height;
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef REGION_H
+#define REGION_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <libxml/tree.h>
+#include "arena.h"
+#include "types.h"
+
+enum region_flags {
+	REGION_LIVE = 1 << 0,
+	/* The config gives this field in percent rather than pixels */
+	REGION_PERCENT_X = 1 << 1,
+	REGION_PERCENT_Y = 1 << 2,
+	REGION_PERCENT_WIDTH = 1 << 3,
+	REGION_PERCENT_HEIGHT = 1 << 4,
+};
+
+/*
+ * All regions as a structure of arrays, indexed by region id. An id stays
+ * valid until its region is removed, after which the slot may be reused.
+ *
+ * Removed slots hold zero geometry, so loops that only do arithmetic on the
+ * geometry may run over all @nr slots without looking at @flags. They are
+ * kept on the @free_slots stack and reused by region_add() before @nr grows.
+ *
+ * The columns and names are allocated from @arena, and freed with it by
+ * region_table_finish().
+ */
+struct region_table {
+	int nr, capacity;
+
+	/* Pixel geometry */
+	double *x, *y, *width, *height;
+
+	/*
+	 * Geometry as it reads in the config, in fixed-point (see FIXED_ONE),
+	 * in percent or pixels according to the REGION_PERCENT_* flags.
+	 * Only fields that changed in pixels are written back, so everything
+	 * else saves exactly as it was read.
+	 */
+	int32_t *fx, *fy, *fwidth, *fheight;
+
+	uint32_t *flags;
+
+	/* Interned, so equal names are equal pointers */
+	const char **name;
+	xmlNode **node;
+
+	int *free_slots, nr_free;
+
+	struct strings *strings;
+	struct arena arena;
+};
+
+/* Skips removed slots. Safe against removing @id itself. */
+#define region_for_each(table, id) \
+	for (int id = 0; id < (table)->nr; id++) \
+		if (!((table)->flags[id] & REGION_LIVE)) {} else
+
+void region_table_init(struct region_table *table);
+void region_table_finish(struct region_table *table);
+
+/* Add a region with zero geometry, returning its id */
+int region_add(struct region_table *table, const char *name, xmlNode *node);
+void region_remove(struct region_table *table, int id);
+
+void region_rename(struct region_table *table, int id, const char *name);
+
+/* Return the id of the region called @name, or -1 */
+int region_find(struct region_table *table, const char *name);
+
+struct dbox region_box(const struct region_table *table, int id);
+void region_set_box(struct region_table *table, int id, const struct dbox *box);
+
+#endif /* REGION_H */
@@ -0,0 +1,732 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <cairo.h>
+#include <limits.h>
+#include <pango/pangocairo.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "atlas.h"
+#include "render.h"
+#include "util.h"
+
+#define TILE_HEIGHT 128
+
+/* Side of the square cells that changes between frames are found in */
+#define CELL_SIZE 64
+
+struct tile {
+	/* Part of the buffer to draw, within one box of the repair */
+	struct box clip;
+};
+
+struct renderer {
+	struct atlas *atlas;
+	PangoFontDescription *font_desc;
+
+	/* Render thread, and the job handed to it under job_mutex */
+	pthread_t thread;
+	bool thread_running;
+	pthread_mutex_t job_mutex;
+	pthread_cond_t job_cond;
+	bool job_pending, job_quit;
+	struct pool_buffer *job_buffer;
+	struct damage job_damage;
+	/* Copy of the draw list, so that the next frame can be built */
+	mu_DrawList frame;
+
+	/*
+	 * Hash of the commands touching each cell of the frame being drawn,
+	 * and of the frame before, @cols x @rows of them and @last_cols x
+	 * @last_rows. Only used by the render thread.
+	 */
+	uint64_t *cells, *last_cells;
+	int cols, rows, last_cols, last_rows, cells_capacity;
+	/* Boxes of the buffer that are being redrawn */
+	struct damage repair;
+
+	/* Only touched from the event loop thread */
+	bool busy;
+	int done_fd;
+	struct loop *loop;
+	void (*done)(struct pool_buffer *buffer, const struct damage *damage,
+		void *data);
+	void *done_data;
+
+	/* Tile workers */
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	uint32_t generation;
+	bool quit;
+
+	/* Current job, protected by mutex */
+	struct pool_buffer *buffer;
+	struct tile *tiles;
+	int nr_tiles, tiles_capacity;
+	int next_tile, tiles_done;
+};
+
+/* Only @clip is being drawn, and anything that cannot reach it is skipped */
+static bool
+rect_in_clip(const mu_Rect *rect, const struct box *clip)
+{
+	return rect->x < clip->x + clip->width && rect->x + rect->w > clip->x
+		&& rect->y < clip->y + clip->height
+		&& rect->y + rect->h > clip->y;
+}
+
+static bool
+same_color(mu_Color a, mu_Color b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+/*
+ * Runs of opaque rects of one color are filled as one path. Translucent
+ * rects are filled one at a time, so that any overlap blends as often as it
+ * would have.
+ */
+static void
+draw_rects(cairo_t *cr, const mu_RectDraw *rects, int nr,
+		const struct box *clip)
+{
+	int i = 0;
+	while (i < nr) {
+		mu_Color color = rects[i].color;
+		cairo_set_source_rgba(cr, color.r / 255.f, color.g / 255.f,
+			color.b / 255.f, color.a / 255.f);
+		do {
+			const mu_Rect *rect = &rects[i].rect;
+			if (rect_in_clip(rect, clip)) {
+				cairo_rectangle(cr, rect->x, rect->y, rect->w,
+					rect->h);
+			}
+			i++;
+		} while (i < nr && color.a == 255
+			&& same_color(rects[i].color, color));
+		cairo_fill(cr);
+	}
+}
+
+static void
+draw_text(struct renderer *renderer, cairo_t *cr, mu_Vec2 *pos,
+		mu_Color *color, const char *str, const struct box *clip)
+{
+	if (atlas_draw_text(renderer->atlas, cairo_get_target(cr), *pos,
+			*color, str, clip)) {
+		return;
+	}
+
+	PangoLayout *layout = pango_cairo_create_layout(cr);
+	pango_layout_set_text(layout, str, -1);
+	pango_layout_set_font_description(layout, renderer->font_desc);
+
+	cairo_save(cr);
+	cairo_set_source_rgba(cr, color->r / 255.f, color->g / 255.f,
+		color->b / 255.f, color->a / 255.f);
+
+	pango_cairo_update_layout (cr, layout);
+
+	cairo_move_to (cr, pos->x, pos->y);
+	pango_cairo_show_layout (cr, layout);
+
+	cairo_restore(cr);
+	g_object_unref(layout);
+}
+
+/* Draw what falls in @clip, and nothing outside it */
+static void
+draw_list(struct renderer *renderer, cairo_t *cr, mu_DrawList *list,
+		const struct box *clip)
+{
+	cairo_save(cr);
+	cairo_rectangle(cr, clip->x, clip->y, clip->width, clip->height);
+	cairo_clip(cr);
+
+	int rect = 0, text = 0;
+	for (int i = 0; i < list->nr_batches; i++) {
+		mu_DrawBatch *batch = &list->batches[i];
+		draw_rects(cr, list->rects + rect, batch->rects_end - rect,
+			clip);
+		rect = batch->rects_end;
+		for (; text < batch->texts_end; text++) {
+			mu_TextDraw *draw = &list->texts[text];
+			if (rect_in_clip(&draw->bounds, clip)) {
+				draw_text(renderer, cr, &draw->pos, &draw->color,
+					list->strings + draw->str, clip);
+			}
+		}
+	}
+	cairo_restore(cr);
+}
+
+static uint64_t
+hash_mix(uint64_t hash, uint64_t value)
+{
+	hash = (hash ^ value) * 0x100000001b3u;
+	return hash ^ hash >> 29;
+}
+
+static uint64_t
+hash_string(const char *s)
+{
+	/* FNV-1a */
+	uint64_t hash = 0xcbf29ce484222325u;
+	for (; *s; s++) {
+		hash = (hash ^ (unsigned char)*s) * 0x100000001b3u;
+	}
+	return hash;
+}
+
+static uint64_t
+pack(int a, int b)
+{
+	return (uint64_t)(uint32_t)a << 32 | (uint32_t)b;
+}
+
+static uint64_t
+pack_color(mu_Color color)
+{
+	return (uint64_t)color.r << 24 | color.g << 16 | color.b << 8
+		| color.a;
+}
+
+/* Mix @value into the hash of every cell that @rect touches */
+static void
+hash_into_cells(struct renderer *renderer, const mu_Rect *rect,
+		uint64_t value)
+{
+	if (rect->w <= 0 || rect->h <= 0) {
+		return;
+	}
+	int x1 = rect->x < 0 ? 0 : rect->x / CELL_SIZE;
+	int y1 = rect->y < 0 ? 0 : rect->y / CELL_SIZE;
+	int x2 = (rect->x + rect->w - 1) / CELL_SIZE;
+	int y2 = (rect->y + rect->h - 1) / CELL_SIZE;
+	x2 = x2 < renderer->cols - 1 ? x2 : renderer->cols - 1;
+	y2 = y2 < renderer->rows - 1 ? y2 : renderer->rows - 1;
+	for (int y = y1; y <= y2; y++) {
+		uint64_t *row = renderer->cells + y * renderer->cols;
+		for (int x = x1; x <= x2; x++) {
+			row[x] = hash_mix(row[x], value);
+		}
+	}
+}
+
+/*
+ * Sum up what the frame draws in each cell of a buffer of @width x @height
+ * pixels, in the order it is drawn in. A cell only shows what is drawn in
+ * it, so cells with the same hash in two frames look the same.
+ */
+static void
+hash_cells(struct renderer *renderer, int width, int height)
+{
+	uint64_t *last = renderer->last_cells;
+	renderer->last_cells = renderer->cells;
+	renderer->cells = last;
+	renderer->last_cols = renderer->cols;
+	renderer->last_rows = renderer->rows;
+
+	renderer->cols = (width + CELL_SIZE - 1) / CELL_SIZE;
+	renderer->rows = (height + CELL_SIZE - 1) / CELL_SIZE;
+	int nr = renderer->cols * renderer->rows;
+	if (nr > renderer->cells_capacity) {
+		renderer->cells = realloc(renderer->cells,
+			nr * sizeof(uint64_t));
+		renderer->last_cells = realloc(renderer->last_cells,
+			nr * sizeof(uint64_t));
+		renderer->cells_capacity = nr;
+	}
+	for (int i = 0; i < nr; i++) {
+		renderer->cells[i] = 0xcbf29ce484222325u;
+	}
+
+	mu_DrawList *list = &renderer->frame;
+	int rect = 0, text = 0;
+	for (int i = 0; i < list->nr_batches; i++) {
+		mu_DrawBatch *batch = &list->batches[i];
+		for (; rect < batch->rects_end; rect++) {
+			mu_RectDraw *draw = &list->rects[rect];
+			uint64_t hash = hash_mix(pack(draw->rect.x,
+				draw->rect.y), pack(draw->rect.w, draw->rect.h));
+			hash = hash_mix(hash, pack_color(draw->color));
+			hash_into_cells(renderer, &draw->rect, hash);
+		}
+		for (; text < batch->texts_end; text++) {
+			mu_TextDraw *draw = &list->texts[text];
+			uint64_t hash = hash_mix(pack(draw->pos.x, draw->pos.y),
+				pack_color(draw->color));
+			hash = hash_mix(hash,
+				hash_string(list->strings + draw->str));
+			hash_into_cells(renderer, &draw->bounds, hash);
+		}
+	}
+}
+
+/*
+ * Add @box to @damage, growing a box that ends right above it with the same
+ * columns if there is one. Returns false if there is no room for it.
+ */
+static bool
+add_box(struct damage *damage, const struct box *box)
+{
+	for (int i = 0; i < damage->nr; i++) {
+		struct box *above = &damage->boxes[i];
+		if (above->x == box->x && above->width == box->width
+				&& above->y + above->height == box->y) {
+			above->height += box->height;
+			return true;
+		}
+	}
+	if (damage->nr == DAMAGE_MAX_BOXES) {
+		return false;
+	}
+	damage->boxes[damage->nr++] = *box;
+	return true;
+}
+
+/*
+ * Gather the cells that differ between @old and @new into disjoint boxes,
+ * in pixels of a buffer of @width x @height. Runs of cells in a row make a
+ * box, which grows down while the rows below have the same run. If there
+ * are more boxes than fit, each row is taken from its first to its last
+ * differing cell instead, and failing that, all of them make one box. A
+ * NULL @old differs everywhere.
+ */
+static void
+diff_cells(const uint64_t *old, const uint64_t *new, int cols, int rows,
+		int width, int height, struct damage *damage)
+{
+	struct box bounds = { 0 };
+	for (int whole_rows = 0; whole_rows < 2; whole_rows++) {
+		bool fits = true;
+		damage->nr = 0;
+		for (int row = 0; row < rows; row++) {
+			const uint64_t *a = old ? old + row * cols : NULL;
+			const uint64_t *b = new + row * cols;
+			int col = 0;
+			while (col < cols) {
+				if (a && a[col] == b[col]) {
+					col++;
+					continue;
+				}
+				int end = col + 1;
+				for (int i = end; i < cols; i++) {
+					if (!a || a[i] != b[i]) {
+						end = i + 1;
+					} else if (!whole_rows) {
+						break;
+					}
+				}
+				int x2 = end < cols ? end * CELL_SIZE : width;
+				int y2 = row < rows - 1
+					? (row + 1) * CELL_SIZE : height;
+				struct box box = {
+					.x = col * CELL_SIZE,
+					.y = row * CELL_SIZE,
+					.width = x2 - col * CELL_SIZE,
+					.height = y2 - row * CELL_SIZE,
+				};
+				box_union(&bounds, &box);
+				fits = fits && add_box(damage, &box);
+				col = end;
+			}
+		}
+		if (fits) {
+			return;
+		}
+	}
+	damage->boxes[0] = bounds;
+	damage->nr = 1;
+}
+
+/*
+ * Both the whole buffer and each tile are drawn with this state, so that
+ * the output does not depend on the number of threads
+ */
+static void
+prepare_cairo(cairo_t *cr)
+{
+	cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+	cairo_identity_matrix(cr);
+}
+
+static void
+draw_tile(struct renderer *renderer, struct tile *tile)
+{
+	struct pool_buffer *buffer = renderer->buffer;
+	int stride = buffer->width * 4;
+	unsigned char *data = (unsigned char *)buffer->data
+		+ tile->clip.y * stride;
+
+	/*
+	 * The device offset lets commands be drawn with buffer coordinates
+	 * while only touching the rows of this tile
+	 */
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(data,
+		CAIRO_FORMAT_ARGB32, buffer->width, tile->clip.height, stride);
+	cairo_surface_set_device_offset(surface, 0, -tile->clip.y);
+	cairo_t *cr = cairo_create(surface);
+	prepare_cairo(cr);
+
+	draw_list(renderer, cr, &renderer->frame, &tile->clip);
+
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	cairo_surface_destroy(surface);
+}
+
+/* Called with the mutex held by both workers and the drawing thread */
+static void
+run_tiles(struct renderer *renderer)
+{
+	while (renderer->next_tile < renderer->nr_tiles) {
+		struct tile *tile = &renderer->tiles[renderer->next_tile++];
+		pthread_mutex_unlock(&renderer->mutex);
+		draw_tile(renderer, tile);
+		pthread_mutex_lock(&renderer->mutex);
+		if (++renderer->tiles_done == renderer->nr_tiles) {
+			pthread_cond_signal(&renderer->done_cond);
+		}
+	}
+}
+
+static void *
+worker_run(void *data)
+{
+	struct renderer *renderer = data;
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&renderer->mutex);
+	for (;;) {
+		while (!renderer->quit && renderer->generation == generation) {
+			pthread_cond_wait(&renderer->work_cond, &renderer->mutex);
+		}
+		if (renderer->quit) {
+			break;
+		}
+		generation = renderer->generation;
+		run_tiles(renderer);
+	}
+	pthread_mutex_unlock(&renderer->mutex);
+	return NULL;
+}
+
+/* Cut each box of the repair into tiles of at most TILE_HEIGHT rows */
+static void
+split_tiles(struct renderer *renderer)
+{
+	const struct damage *repair = &renderer->repair;
+	int nr_tiles = 0;
+	for (int i = 0; i < repair->nr; i++) {
+		nr_tiles += (repair->boxes[i].height + TILE_HEIGHT - 1)
+			/ TILE_HEIGHT;
+	}
+	if (nr_tiles > renderer->tiles_capacity) {
+		renderer->tiles = realloc(renderer->tiles,
+			nr_tiles * sizeof(struct tile));
+		renderer->tiles_capacity = nr_tiles;
+	}
+	renderer->nr_tiles = 0;
+	for (int i = 0; i < repair->nr; i++) {
+		const struct box *box = &repair->boxes[i];
+		for (int y = 0; y < box->height; y += TILE_HEIGHT) {
+			struct tile *tile = &renderer->tiles[renderer->nr_tiles++];
+			tile->clip = *box;
+			tile->clip.y += y;
+			tile->clip.height = box->height - y < TILE_HEIGHT
+				? box->height - y : TILE_HEIGHT;
+		}
+	}
+}
+
+static void
+draw_tiled(struct renderer *renderer, struct pool_buffer *buffer)
+{
+	split_tiles(renderer);
+
+	/* Make sure cairo has no pending work on the buffer we draw behind */
+	cairo_surface_flush(buffer->surface);
+
+	pthread_mutex_lock(&renderer->mutex);
+	renderer->buffer = buffer;
+	renderer->next_tile = 0;
+	renderer->tiles_done = 0;
+	renderer->generation++;
+	pthread_cond_broadcast(&renderer->work_cond);
+	run_tiles(renderer);
+	while (renderer->tiles_done < renderer->nr_tiles) {
+		pthread_cond_wait(&renderer->done_cond, &renderer->mutex);
+	}
+	renderer->buffer = NULL;
+	pthread_mutex_unlock(&renderer->mutex);
+
+	cairo_surface_mark_dirty(buffer->surface);
+}
+
+/*
+ * Bring @buffer up to date with the frame, and set @damage to what changed
+ * since the frame before. Only the cells where the frame differs from what
+ * was last drawn into the buffer are cleared and drawn again.
+ */
+static void
+draw(struct renderer *renderer, struct pool_buffer *buffer,
+		struct damage *damage)
+{
+	hash_cells(renderer, buffer->width, buffer->height);
+	int nr_cells = renderer->cols * renderer->rows;
+
+	const uint64_t *last = renderer->last_cols == renderer->cols
+		&& renderer->last_rows == renderer->rows
+		? renderer->last_cells : NULL;
+	diff_cells(last, renderer->cells, renderer->cols, renderer->rows,
+		buffer->width, buffer->height, damage);
+
+	struct damage *repair = &renderer->repair;
+	diff_cells(buffer->cells, renderer->cells, renderer->cols,
+		renderer->rows, buffer->width, buffer->height, repair);
+	if (!buffer->cells) {
+		buffer->cells = malloc(nr_cells * sizeof(uint64_t));
+	}
+	memcpy(buffer->cells, renderer->cells, nr_cells * sizeof(uint64_t));
+	if (!repair->nr) {
+		return;
+	}
+
+	for (int i = 0; i < repair->nr; i++) {
+		clear_buffer(buffer, &repair->boxes[i]);
+	}
+	if (renderer->nr_threads > 1) {
+		draw_tiled(renderer, buffer);
+		return;
+	}
+	prepare_cairo(buffer->cairo);
+	for (int i = 0; i < repair->nr; i++) {
+		draw_list(renderer, buffer->cairo, &renderer->frame,
+			&repair->boxes[i]);
+	}
+}
+
+static void *
+render_thread_run(void *data)
+{
+	struct renderer *renderer = data;
+
+	pthread_mutex_lock(&renderer->job_mutex);
+	for (;;) {
+		while (!renderer->job_quit && !renderer->job_pending) {
+			pthread_cond_wait(&renderer->job_cond,
+				&renderer->job_mutex);
+		}
+		if (renderer->job_quit) {
+			break;
+		}
+		renderer->job_pending = false;
+		struct pool_buffer *buffer = renderer->job_buffer;
+		pthread_mutex_unlock(&renderer->job_mutex);
+
+		struct damage damage;
+		draw(renderer, buffer, &damage);
+		cairo_surface_flush(buffer->surface);
+
+		pthread_mutex_lock(&renderer->job_mutex);
+		renderer->job_damage = damage;
+		uint64_t one = 1;
+		if (write(renderer->done_fd, &one, sizeof(one)) < 0) {
+			LOG_ERRNO(LOG_ERROR, "unable to signal finished frame");
+		}
+	}
+	pthread_mutex_unlock(&renderer->job_mutex);
+	return NULL;
+}
+
+static void
+handle_frame_done(int fd, short mask, void *data)
+{
+	struct renderer *renderer = data;
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&renderer->job_mutex);
+	struct pool_buffer *buffer = renderer->job_buffer;
+	struct damage damage = renderer->job_damage;
+	renderer->job_buffer = NULL;
+	pthread_mutex_unlock(&renderer->job_mutex);
+
+	renderer->busy = false;
+	renderer->done(buffer, &damage, renderer->done_data);
+}
+
+void
+renderer_start(struct renderer *renderer, struct loop *loop,
+	void (*done)(struct pool_buffer *buffer, const struct damage *damage,
+		void *data),
+	void *data)
+{
+	renderer->loop = loop;
+	renderer->done = done;
+	renderer->done_data = data;
+	loop_add_fd(loop, renderer->done_fd, POLLIN, handle_frame_done,
+		renderer);
+	if (pthread_create(&renderer->thread, NULL, render_thread_run,
+			renderer)) {
+		LOG(LOG_ERROR, "unable to create render thread");
+		exit(EXIT_FAILURE);
+	}
+	renderer->thread_running = true;
+}
+
+bool
+renderer_busy(struct renderer *renderer)
+{
+	return renderer->busy;
+}
+
+/* Copy @nr items of @size bytes, growing @dst as needed */
+static void *
+copy_items(void *dst, int *capacity, const void *src, int nr, size_t size)
+{
+	if (nr > *capacity) {
+		*capacity = nr * 2;
+		dst = realloc(dst, *capacity * size);
+	}
+	if (nr) {
+		memcpy(dst, src, nr * size);
+	}
+	return dst;
+}
+
+static void
+freeze_list(struct renderer *renderer, mu_Context *ctx)
+{
+	mu_DrawList *src = &ctx->draw_list;
+	mu_DrawList *dst = &renderer->frame;
+	dst->rects = copy_items(dst->rects, &dst->rects_capacity, src->rects,
+		src->nr_rects, sizeof(*src->rects));
+	dst->nr_rects = src->nr_rects;
+	dst->texts = copy_items(dst->texts, &dst->texts_capacity, src->texts,
+		src->nr_texts, sizeof(*src->texts));
+	dst->nr_texts = src->nr_texts;
+	dst->strings = copy_items(dst->strings, &dst->strings_capacity,
+		src->strings, src->strings_size, 1);
+	dst->strings_size = src->strings_size;
+	dst->batches = copy_items(dst->batches, &dst->batches_capacity,
+		src->batches, src->nr_batches, sizeof(*src->batches));
+	dst->nr_batches = src->nr_batches;
+
+	/*
+	 * Rasterize any missing glyphs here, so that the render thread and
+	 * tile workers only ever read the atlas
+	 */
+	for (int i = 0; i < dst->nr_texts; i++) {
+		atlas_text_width(renderer->atlas,
+			dst->strings + dst->texts[i].str, -1);
+	}
+}
+
+void
+renderer_submit(struct renderer *renderer, mu_Context *ctx,
+		struct pool_buffer *buffer)
+{
+	assert(!renderer->busy);
+	renderer->busy = true;
+
+	/* The render thread is idle, so the frame is ours */
+	freeze_list(renderer, ctx);
+
+	pthread_mutex_lock(&renderer->job_mutex);
+	renderer->job_buffer = buffer;
+	renderer->job_pending = true;
+	pthread_cond_signal(&renderer->job_cond);
+	pthread_mutex_unlock(&renderer->job_mutex);
+}
+
+struct renderer *
+renderer_create(int nr_threads, struct atlas *atlas,
+		const PangoFontDescription *font_desc)
+{
+	struct renderer *renderer = calloc(1, sizeof(struct renderer));
+	renderer->atlas = atlas;
+	renderer->font_desc = pango_font_description_copy(font_desc);
+	renderer->done_fd = eventfd(0, EFD_CLOEXEC);
+	if (renderer->done_fd < 0) {
+		LOG_ERRNO(LOG_ERROR, "eventfd()");
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init(&renderer->job_mutex, NULL);
+	pthread_cond_init(&renderer->job_cond, NULL);
+
+	renderer->nr_threads = nr_threads > 1 ? nr_threads : 1;
+	if (renderer->nr_threads == 1) {
+		return renderer;
+	}
+
+	pthread_mutex_init(&renderer->mutex, NULL);
+	pthread_cond_init(&renderer->work_cond, NULL);
+	pthread_cond_init(&renderer->done_cond, NULL);
+	renderer->threads = calloc(renderer->nr_threads - 1, sizeof(pthread_t));
+	for (int i = 0; i < renderer->nr_threads - 1; i++) {
+		if (pthread_create(&renderer->threads[i], NULL, worker_run,
+				renderer)) {
+			LOG(LOG_ERROR, "unable to create render thread");
+			renderer->nr_threads = i + 1;
+			break;
+		}
+	}
+	LOG(LOG_INFO, "rendering with %d threads", renderer->nr_threads);
+	return renderer;
+}
+
+void
+renderer_destroy(struct renderer *renderer)
+{
+	if (!renderer) {
+		return;
+	}
+
+	/* Lets any frame being drawn finish, but drops a pending one */
+	if (renderer->thread_running) {
+		pthread_mutex_lock(&renderer->job_mutex);
+		renderer->job_quit = true;
+		pthread_cond_signal(&renderer->job_cond);
+		pthread_mutex_unlock(&renderer->job_mutex);
+		pthread_join(renderer->thread, NULL);
+		loop_remove_fd(renderer->loop, renderer->done_fd);
+	}
+	pthread_cond_destroy(&renderer->job_cond);
+	pthread_mutex_destroy(&renderer->job_mutex);
+	close(renderer->done_fd);
+	free(renderer->frame.rects);
+	free(renderer->frame.texts);
+	free(renderer->frame.strings);
+	free(renderer->frame.batches);
+
+	if (renderer->threads) {
+		pthread_mutex_lock(&renderer->mutex);
+		renderer->quit = true;
+		pthread_cond_broadcast(&renderer->work_cond);
+		pthread_mutex_unlock(&renderer->mutex);
+		for (int i = 0; i < renderer->nr_threads - 1; i++) {
+			pthread_join(renderer->threads[i], NULL);
+		}
+		free(renderer->threads);
+		pthread_cond_destroy(&renderer->done_cond);
+		pthread_cond_destroy(&renderer->work_cond);
+		pthread_mutex_destroy(&renderer->mutex);
+	}
+	free(renderer->tiles);
+	free(renderer->cells);
+	free(renderer->last_cells);
+	pango_font_description_free(renderer->font_desc);
+	free(renderer);
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef RENDER_H
+#define RENDER_H
+#include <pango/pangocairo.h>
+#include <stdbool.h>
+#include "microui.h"
+#include "util.h"
+
+struct atlas;
+struct loop;
+struct renderer;
+
+/*
+ * Frames are rasterized on a render thread so that protocol and input
+ * handling never wait for drawing. With @nr_threads > 1 the render thread
+ * additionally splits the buffer into horizontal tiles which are rasterized
+ * in parallel by @nr_threads - 1 workers.
+ */
+struct renderer *renderer_create(int nr_threads, struct atlas *atlas,
+	const PangoFontDescription *font_desc);
+void renderer_destroy(struct renderer *renderer);
+
+/*
+ * Start the render thread. Once a submitted frame has been drawn, @done is
+ * called from @loop with the buffer and the area that changed since the
+ * frame before.
+ */
+void renderer_start(struct renderer *renderer, struct loop *loop,
+	void (*done)(struct pool_buffer *buffer, const struct damage *damage,
+		void *data),
+	void *data);
+
+/* True while a submitted frame has not been reported as done yet */
+bool renderer_busy(struct renderer *renderer);
+
+/*
+ * Freeze the draw list of @ctx and hand it to the render thread to be
+ * drawn into @buffer on top of a transparent background. Only what changed
+ * since the last frame drawn into @buffer is drawn again.
+ */
+void renderer_submit(struct renderer *renderer, mu_Context *ctx,
+	struct pool_buffer *buffer);
+
+#endif /* RENDER_H */
@@ -1,268 +1,688 @@
 // SPDX-License-Identifier: GPL-2.0-only
 #define _POSIX_C_SOURCE 200809L
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <wayland-server-core.h>
+#include "region.h"
 #include "settings.h"
 #include "util.h"
-#include "window.h"
 
 static xmlDoc *doc;
-static struct wl_list regions;
+static struct region_table regions;
 static xmlNode *in_region;
-static struct region *current_region;
+static int current_region = -1;
+
+/* Whether @doc differs from the file, which is as @disk says */
+static bool modified;
+static struct stat disk;
+
+static bool take_in_changes(const char *filename);
+
+/* 100% in fixed-point */
+#define PERCENT_FULL (100 * FIXED_ONE)
+
+/* Multiplier taking a fixed-point field in pixels to pixels */
+#define PIXEL_SCALE (1.0 / FIXED_ONE)
+
+/*
+ * Work out one pixel column from its fixed-point column. These run over every
+ * slot of the table, removed ones too, which are all zero, so that the loop
+ * body is a select and a multiply over contiguous arrays, which compilers
+ * turn into vector code.
+ */
+static void
+pixels_from_fixed(double *pixels, const int32_t *fixed, uint32_t percent_flag,
+		double size)
+{
+	const uint32_t *flags = regions.flags;
+	double percent_scale = size / PERCENT_FULL;
+	for (int i = 0; i < regions.nr; i++) {
+		pixels[i] = fixed[i] * (flags[i] & percent_flag
+			? percent_scale : PIXEL_SCALE);
+	}
+}
 
 void
-convert_regions_from_percentage_to_pixels(struct window *window)
+convert_regions_from_percentage_to_pixels(double width, double height)
 {
-	double width = window->surface->width;
-	double height = window->surface->height;
-	struct region *region;
-	wl_list_for_each(region, &regions, link) {
-		if (region->ispercentage.x) {
-			region->dbox.x *= width;
-			region->dbox.x /= 100.0;
-			region->ispercentage.x = false;
-		}
-		if (region->ispercentage.y) {
-			region->dbox.y *= height;
-			region->dbox.y /= 100.0;
-			region->ispercentage.y = false;
-		}
-		if (region->ispercentage.width) {
-			region->dbox.width *= width;
-			region->dbox.width /= 100.0;
-			region->ispercentage.width = false;
-		}
-		if (region->ispercentage.height) {
-			region->dbox.height *= height;
-			region->dbox.height /= 100.0;
-			region->ispercentage.height = false;
+	pixels_from_fixed(regions.x, regions.fx, REGION_PERCENT_X, width);
+	pixels_from_fixed(regions.y, regions.fy, REGION_PERCENT_Y, height);
+	pixels_from_fixed(regions.width, regions.fwidth,
+		REGION_PERCENT_WIDTH, width);
+	pixels_from_fixed(regions.height, regions.fheight,
+		REGION_PERCENT_HEIGHT, height);
+}
+
+/*
+ * Percentage of @size covered by @pixels, in fixed-point. Unless @fractional,
+ * round to whole percent like older versions did.
+ */
+static int32_t
+pixels_to_percent(double pixels, double size, bool fractional)
+{
+	if (size <= 0) {
+		return 0;
+	}
+	double percent = pixels * 100.0 / size;
+	if (fractional) {
+		return (int32_t)lround(percent * FIXED_ONE);
+	}
+	return (int32_t)lround(percent) * FIXED_ONE;
+}
+
+/*
+ * Bring one fixed-point column up to date with its pixels, for an output
+ * @size pixels across. Fields that still hold exactly what the fixed-point
+ * value converts to were not edited, and keep their value and unit. Edited
+ * fields, which are few, are stored as percentages.
+ */
+static void
+fixed_from_pixels(int32_t *fixed, const double *pixels, uint32_t percent_flag,
+		double size, bool fractional)
+{
+	uint32_t *flags = regions.flags;
+	double percent_scale = size / PERCENT_FULL;
+	for (int i = 0; i < regions.nr; i++) {
+		double converted = fixed[i] * (flags[i] & percent_flag
+			? percent_scale : PIXEL_SCALE);
+		if (pixels[i] != converted) {
+			fixed[i] = pixels_to_percent(pixels[i], size,
+				fractional);
+			flags[i] |= percent_flag;
 		}
 	}
 }
 
 static void
-convert_regions_from_pixels_to_percentage(struct window *window, struct wl_list *regions)
+update_fixed(double width, double height, bool fractional)
 {
-	double width = (double)window->surface->width;
-	double height = (double)window->surface->height;
-	struct region *region;
-	wl_list_for_each(region, regions, link) {
-		if (!region->ispercentage.x) {
-			region->dbox.x *= 100.0;
-			region->dbox.x /= width;
-			region->ispercentage.x = true;
+	fixed_from_pixels(regions.fx, regions.x, REGION_PERCENT_X, width,
+		fractional);
+	fixed_from_pixels(regions.fy, regions.y, REGION_PERCENT_Y, height,
+		fractional);
+	fixed_from_pixels(regions.fwidth, regions.width, REGION_PERCENT_WIDTH,
+		width, fractional);
+	fixed_from_pixels(regions.fheight, regions.height,
+		REGION_PERCENT_HEIGHT, height, fractional);
+}
+
+/*
+ * Carry one pixel column over from an output @old_size pixels across to one
+ * @size across. Fields that were not edited are worked out afresh from their
+ * fixed-point value. Edited ones are scaled as they are, without going
+ * through fixed-point, so that resizing back and forth does not round them
+ * again and again; they are only rounded by settings_save().
+ */
+static void
+rescale_pixels(double *pixels, const int32_t *fixed, uint32_t percent_flag,
+		double old_size, double size)
+{
+	const uint32_t *flags = regions.flags;
+	double old_percent_scale = old_size / PERCENT_FULL;
+	double percent_scale = size / PERCENT_FULL;
+	double ratio = old_size > 0 ? size / old_size : 1.0;
+	for (int i = 0; i < regions.nr; i++) {
+		bool percent = flags[i] & percent_flag;
+		double converted = fixed[i]
+			* (percent ? old_percent_scale : PIXEL_SCALE);
+		if (pixels[i] == converted) {
+			pixels[i] = fixed[i]
+				* (percent ? percent_scale : PIXEL_SCALE);
+		} else {
+			pixels[i] *= ratio;
 		}
-		if (!region->ispercentage.y) {
-			region->dbox.y *= 100.0;
-			region->dbox.y /= height;
-			region->ispercentage.y = true;
+	}
+}
+
+void
+settings_rescale(double old_width, double old_height, double width,
+		double height)
+{
+	rescale_pixels(regions.x, regions.fx, REGION_PERCENT_X, old_width,
+		width);
+	rescale_pixels(regions.y, regions.fy, REGION_PERCENT_Y, old_height,
+		height);
+	rescale_pixels(regions.width, regions.fwidth, REGION_PERCENT_WIDTH,
+		old_width, width);
+	rescale_pixels(regions.height, regions.fheight, REGION_PERCENT_HEIGHT,
+		old_height, height);
+}
+
+/*
+ * Scale one column by @scale, for an output @size pixels across. Fields that
+ * were not edited are scaled in fixed-point, in the unit they were read in,
+ * so that pixels stay pixels. Edited fields are scaled in pixels.
+ */
+static void
+scale_column(double *pixels, int32_t *fixed, uint32_t percent_flag,
+		double size, double scale)
+{
+	const uint32_t *flags = regions.flags;
+	double percent_scale = size / PERCENT_FULL;
+	for (int i = 0; i < regions.nr; i++) {
+		double unit = flags[i] & percent_flag
+			? percent_scale : PIXEL_SCALE;
+		if (pixels[i] != fixed[i] * unit) {
+			pixels[i] *= scale;
+			continue;
 		}
-		if (!region->ispercentage.width) {
-			region->dbox.width *= 100.0;
-			region->dbox.width /= width;
-			region->ispercentage.width = true;
+		double scaled = round(fixed[i] * scale);
+		fixed[i] = (int32_t)fmax(INT32_MIN, fmin(INT32_MAX, scaled));
+		pixels[i] = fixed[i] * unit;
+	}
+}
+
+void
+settings_scale(double scale, double width, double height)
+{
+	scale_column(regions.x, regions.fx, REGION_PERCENT_X, width, scale);
+	scale_column(regions.y, regions.fy, REGION_PERCENT_Y, height, scale);
+	scale_column(regions.width, regions.fwidth, REGION_PERCENT_WIDTH,
+		width, scale);
+	scale_column(regions.height, regions.fheight, REGION_PERCENT_HEIGHT,
+		height, scale);
+}
+
+/* Print @value with as few decimals as it takes to be exact */
+static void
+format_fixed(char *buf, size_t len, int32_t value, bool ispercentage)
+{
+	const char *sign = value < 0 ? "-" : "";
+	int64_t abs = value < 0 ? -(int64_t)value : value;
+	int64_t whole = abs / FIXED_ONE;
+	int frac = abs % FIXED_ONE;
+	const char *unit = ispercentage ? "%" : "";
+
+	if (!frac) {
+		snprintf(buf, len, "%s%ld%s", sign, (long)whole, unit);
+		return;
+	}
+	int digits = 4;
+	while (!(frac % 10)) {
+		frac /= 10;
+		digits--;
+	}
+	snprintf(buf, len, "%s%ld.%0*d%s", sign, (long)whole, digits, frac,
+		unit);
+}
+
+/*
+ * Parse a decimal number with up to four decimals, rounding any further
+ * ones. Fixed-point throughout, so that whatever format_fixed() writes reads
+ * back exactly. @percent is set if the number is followed by '%'; any other
+ * unit is ignored.
+ */
+static int32_t
+parse_fixed(const char *s, bool *percent)
+{
+	while (isspace((unsigned char)*s)) {
+		s++;
+	}
+	bool negative = *s == '-';
+	if (*s == '-' || *s == '+') {
+		s++;
+	}
+	int64_t value = 0;
+	for (; isdigit((unsigned char)*s); s++) {
+		if (value < INT32_MAX) {
+			value = value * 10 + (*s - '0');
 		}
-		if (!region->ispercentage.height) {
-			region->dbox.height *= 100.0;
-			region->dbox.height /= height;
-			region->ispercentage.height = true;
+	}
+	value *= FIXED_ONE;
+	if (*s == '.') {
+		s++;
+		int scale = FIXED_ONE / 10;
+		for (; isdigit((unsigned char)*s); s++) {
+			if (scale) {
+				value += (*s - '0') * scale;
+				scale /= 10;
+			} else {
+				/* Round half up on the first digit that does not fit */
+				value += *s >= '5';
+				for (; isdigit((unsigned char)*s); s++) {
+					;
+				}
+				break;
+			}
 		}
 	}
+	while (isspace((unsigned char)*s)) {
+		s++;
+	}
+	*percent = *s == '%';
+	if (value > INT32_MAX) {
+		value = INT32_MAX;
+	}
+	return (int32_t)(negative ? -value : value);
 }
 
-void
-settings_save(const struct state *state)
+/* Whether something else wrote the config since it was read or saved */
+static bool
+file_changed(const char *filename)
 {
-	convert_regions_from_pixels_to_percentage(state->window, &regions);
+	struct stat st;
+	if (stat(filename, &st)) {
+		return false;
+	}
+	return st.st_dev != disk.st_dev || st.st_ino != disk.st_ino
+		|| st.st_size != disk.st_size
+		|| st.st_mtim.tv_sec != disk.st_mtim.tv_sec
+		|| st.st_mtim.tv_nsec != disk.st_mtim.tv_nsec;
+}
+
+int
+settings_save(const struct config *config, double width, double height)
+{
+	update_fixed(width, height, config->fractional_percent);
+	region_for_each(&regions, id) {
+		uint32_t flags = regions.flags[id];
 
-	struct region *region;
-	wl_list_for_each(region, &regions, link) {
-		xmlAttr *attr = region->node->properties;
+		xmlAttr *attr = regions.node[id]->properties;
 		for (; attr; attr = attr->next) {
 			char buf[32];
 			xmlNode *node = attr->children;
 			if (!strcmp((char *)node->parent->name, "x")) {
-				snprintf(buf, sizeof(buf), "%d%%", (int)round(region->dbox.x));
+				format_fixed(buf, sizeof(buf), regions.fx[id],
+					flags & REGION_PERCENT_X);
 			} else if (!strcmp((char *)node->parent->name, "y")) {
-				snprintf(buf, sizeof(buf), "%d%%", (int)round(region->dbox.y));
+				format_fixed(buf, sizeof(buf), regions.fy[id],
+					flags & REGION_PERCENT_Y);
 			} else if (!strcmp((char *)node->parent->name, "width")) {
-				snprintf(buf, sizeof(buf), "%d%%", (int)round(region->dbox.width));
+				format_fixed(buf, sizeof(buf), regions.fwidth[id],
+					flags & REGION_PERCENT_WIDTH);
 			} else if (!strcmp((char *)node->parent->name, "height")) {
-				snprintf(buf, sizeof(buf), "%d%%", (int)round(region->dbox.height));
+				format_fixed(buf, sizeof(buf), regions.fheight[id],
+					flags & REGION_PERCENT_HEIGHT);
 			} else {
 				continue;
 			}
+			if (node->content
+					&& !strcmp((char *)node->content, buf)) {
+				continue;
+			}
 			xmlNodeSetContent(node, (const xmlChar *)buf);
+			modified = true;
 		}
 	}
-	xmlSaveFormatFile(state->config->filename, doc, 1);
+	if (!modified) {
+		return 0;
+	}
+	if (file_changed(config->filename)
+			&& !take_in_changes(config->filename)) {
+		return -1;
+	}
+
+	/*
+	 * libxml2 settings are per thread, and the config may have been read
+	 * on another one
+	 */
+	xmlIndentTreeOutput = 1;
+	if (xmlSaveFormatFile(config->filename, doc, 1) < 0) {
+		LOG(LOG_ERROR, "cannot save config file (%s)",
+			config->filename);
+		return -1;
+	}
+	stat(config->filename, &disk);
+	modified = false;
+	return 1;
 }
 
-/* Return xpath style nodename, e.g <a><b></b></a> becomes /a/b */
-static char *
-nodename(xmlNode *node, char *buf, int len)
+int
+settings_region_add(int after)
 {
-	if (!node || !node->name) {
-		return NULL;
+	char name[32];
+	for (int i = 1;; i++) {
+		snprintf(name, sizeof(name), "region-%d", i);
+		if (region_find(&regions, name) < 0) {
+			break;
+		}
 	}
 
-	/* Ignore superflous '/text' in node name */
-	if (node->parent && !strcmp((char *)node->name, "text")) {
-		node = node->parent;
-	}
+	/* Geometry attributes are filled in by settings_save() */
+	xmlNode *node = xmlNewNode(NULL, (const xmlChar *)"region");
+	xmlNewProp(node, (const xmlChar *)"name", (const xmlChar *)name);
+	xmlNewProp(node, (const xmlChar *)"x", (const xmlChar *)"0%");
+	xmlNewProp(node, (const xmlChar *)"y", (const xmlChar *)"0%");
+	xmlNewProp(node, (const xmlChar *)"width", (const xmlChar *)"0%");
+	xmlNewProp(node, (const xmlChar *)"height", (const xmlChar *)"0%");
+	xmlAddNextSibling(regions.node[after], node);
+	modified = true;
 
-	buf += len;
-	*--buf = 0;
-	len--;
+	return region_add(&regions, name, node);
+}
 
-	for (;;) {
-		const char *name = (char *)node->name;
-		int i = strlen(name);
-		while (--i >= 0) {
-			unsigned char c = name[i];
-			*--buf = tolower(c);
-			if (!--len)
-				return buf;
-		}
-		node = node->parent;
-		if (!node || !node->name) {
-			*--buf = '/';
-			return buf;
-		}
-		*--buf = '/';
-		if (!--len)
-			return buf;
+bool
+settings_region_rename(int id, const char *name)
+{
+	int other = region_find(&regions, name);
+	if (other >= 0) {
+		return other == id;
 	}
+	xmlSetProp(regions.node[id], (const xmlChar *)"name",
+		(const xmlChar *)name);
+	region_rename(&regions, id, name);
+	modified = true;
+	return true;
 }
 
-static struct region *
-region_create(const char *name)
+void
+settings_region_remove(int id)
 {
-	struct region *region = calloc(1, sizeof(struct region));
-	region->name = strdup(name);
-	region->node = in_region;
-	wl_list_insert(regions.prev, &region->link);
-	return region;
+	xmlUnlinkNode(regions.node[id]);
+	xmlFreeNode(regions.node[id]);
+	region_remove(&regions, id);
+	modified = true;
 }
 
-static void
-fill_region(char *nodename, char *content)
+enum element {
+	ELEMENT_UNKNOWN,
+	ELEMENT_LABWC_CONFIG,
+	ELEMENT_REGIONS,
+	ELEMENT_REGION,
+	ELEMENT_NAME,
+	ELEMENT_X,
+	ELEMENT_Y,
+	ELEMENT_WIDTH,
+	ELEMENT_HEIGHT,
+};
+
+/*
+ * The element and attribute names the parser looks for, each in the slot
+ * element_hash() gives it. The multipliers there were searched for so that
+ * no two of these names share a slot, so a name is either in its slot or
+ * not one of them.
+ */
+#define ELEMENT_SLOTS 8
+static const struct {
+	const char *name;
+	enum element element;
+} elements[ELEMENT_SLOTS] = {
+	{ "regions", ELEMENT_REGIONS },
+	{ "x", ELEMENT_X },
+	{ "height", ELEMENT_HEIGHT },
+	{ "name", ELEMENT_NAME },
+	{ "region", ELEMENT_REGION },
+	{ "labwc_config", ELEMENT_LABWC_CONFIG },
+	{ "y", ELEMENT_Y },
+	{ "width", ELEMENT_WIDTH },
+};
+
+static unsigned int
+element_hash(const char *name, size_t len)
 {
-	if (!content) {
-		return;
+	unsigned int first = tolower((unsigned char)name[0]);
+	unsigned int last = tolower((unsigned char)name[len - 1]);
+	return (len + 6 * first + 7 * last) % ELEMENT_SLOTS;
+}
+
+static enum element
+element_lookup(const xmlChar *name)
+{
+	size_t len = strlen((const char *)name);
+	if (!len) {
+		return ELEMENT_UNKNOWN;
 	}
+	unsigned int slot = element_hash((const char *)name, len);
+	if (strcasecmp((const char *)name, elements[slot].name)) {
+		return ELEMENT_UNKNOWN;
+	}
+	return elements[slot].element;
+}
 
-	if (!strcmp(nodename, "/labwc_config/regions/region/name")) {
-		current_region = region_create(content);
-	} else if (!current_region) {
-		LOG(LOG_ERROR, "expect <region name=\"\"> element first");
-		return;
-	} else if (!strcmp(nodename, "/labwc_config/regions/region/x")) {
-		current_region->ispercentage.x = !!strchr(content, '%');
-		current_region->dbox.x = atoi(content);
-	} else if (!strcmp(nodename, "/labwc_config/regions/region/y")) {
-		current_region->ispercentage.y = !!strchr(content, '%');
-		current_region->dbox.y = atoi(content);
-	} else if (!strcmp(nodename, "/labwc_config/regions/region/width")) {
-		current_region->ispercentage.width = !!strchr(content, '%');
-		current_region->dbox.width = atoi(content);
-	} else if (!strcmp(nodename, "/labwc_config/regions/region/height")) {
-		current_region->ispercentage.height = !!strchr(content, '%');
-		current_region->dbox.height = atoi(content);
+/*
+ * Where a node is in the document, as far as the parser cares. Worked out
+ * from the parent's as the walk descends, rather than by building the path.
+ */
+enum path {
+	/* Above the root element */
+	PATH_TOP,
+	PATH_OTHER,
+	PATH_CONFIG,
+	PATH_REGIONS,
+	PATH_REGION,
+	PATH_REGION_NAME,
+	PATH_REGION_X,
+	PATH_REGION_Y,
+	PATH_REGION_WIDTH,
+	PATH_REGION_HEIGHT,
+};
+
+static enum path
+descend(enum path path, const xmlChar *name)
+{
+	enum element element = element_lookup(name);
+	switch (path) {
+	case PATH_TOP:
+		return element == ELEMENT_LABWC_CONFIG ? PATH_CONFIG : PATH_OTHER;
+	case PATH_CONFIG:
+		return element == ELEMENT_REGIONS ? PATH_REGIONS : PATH_OTHER;
+	case PATH_REGIONS:
+		return element == ELEMENT_REGION ? PATH_REGION : PATH_OTHER;
+	case PATH_REGION:
+		switch (element) {
+		case ELEMENT_NAME:
+			return PATH_REGION_NAME;
+		case ELEMENT_X:
+			return PATH_REGION_X;
+		case ELEMENT_Y:
+			return PATH_REGION_Y;
+		case ELEMENT_WIDTH:
+			return PATH_REGION_WIDTH;
+		case ELEMENT_HEIGHT:
+			return PATH_REGION_HEIGHT;
+		default:
+			return PATH_OTHER;
+		}
+	default:
+		return PATH_OTHER;
 	}
 }
 
 static void
-entry(xmlNode *node, char *nodename, char *content)
+fill_field(int32_t *field, uint32_t percent_flag, const char *content)
 {
-	if (!nodename) {
-		return;
-	}
-	if (in_region) {
-		fill_region(nodename, content);
+	bool percent;
+	*field = parse_fixed(content, &percent);
+	if (percent) {
+		regions.flags[current_region] |= percent_flag;
 	}
 }
 
 static void
-process_node(xmlNode *node)
+fill_region(enum path path, const char *content)
 {
-	char *content;
-	static char buffer[256];
-	char *name;
-
-	content = (char *)node->content;
-	if (xmlIsBlankNode(node)) {
+	if (path == PATH_REGION_NAME) {
+		current_region = region_add(&regions, content, in_region);
+		return;
+	}
+	if (path < PATH_REGION_X) {
+		return;
+	}
+	if (current_region < 0) {
+		LOG(LOG_ERROR, "expect <region name=\"\"> element first");
 		return;
 	}
-	name = nodename(node, buffer, sizeof(buffer));
-	entry(node, name, content);
+	switch (path) {
+	case PATH_REGION_X:
+		fill_field(&regions.fx[current_region], REGION_PERCENT_X,
+			content);
+		break;
+	case PATH_REGION_Y:
+		fill_field(&regions.fy[current_region], REGION_PERCENT_Y,
+			content);
+		break;
+	case PATH_REGION_WIDTH:
+		fill_field(&regions.fwidth[current_region],
+			REGION_PERCENT_WIDTH, content);
+		break;
+	case PATH_REGION_HEIGHT:
+		fill_field(&regions.fheight[current_region],
+			REGION_PERCENT_HEIGHT, content);
+		break;
+	default:
+		break;
+	}
 }
 
-static void xml_tree_walk(xmlNode *node);
+static void xml_tree_walk(xmlNode *node, enum path parent);
 
 static void
-traverse(xmlNode *n)
+traverse(xmlNode *n, enum path path)
 {
-	process_node(n);
+	if (n->content && !xmlIsBlankNode(n)) {
+		fill_region(path, (char *)n->content);
+	}
 	for (xmlAttr *attr = n->properties; attr; attr = attr->next) {
-		xml_tree_walk(attr->children);
+		xml_tree_walk(attr->children, descend(path, attr->name));
 	}
-	xml_tree_walk(n->children);
+	xml_tree_walk(n->children, path);
 }
 
 static void
-xml_tree_walk(xmlNode *node)
+xml_tree_walk(xmlNode *node, enum path parent)
 {
 	for (xmlNode *n = node; n && n->name; n = n->next) {
-		if (!strcasecmp((char *)n->name, "comment")) {
+		if (n->type == XML_COMMENT_NODE) {
 			continue;
 		}
-		if (!strcasecmp((char *)n->name, "region")) {
+		/* Text is part of the element or attribute it is in */
+		enum path path = n->type == XML_TEXT_NODE
+			? parent : descend(parent, n->name);
+		if (path == PATH_REGION) {
 			in_region = n;
-			traverse(n);
+			traverse(n, path);
 			in_region = NULL;
 			continue;
 		}
-		traverse(n);
+		traverse(n, path);
 	}
 }
 
-struct wl_list *
+/*
+ * Parse the config from one read() of the whole file into memory, rather than
+ * through libxml2's buffered I/O, which is slow for home directories on NFS.
+ * Unlike a mapping, a buffer cannot fault with SIGBUS when an editor
+ * truncates the file while it is parsed; a short read just fails to parse.
+ *
+ * Names are not shared through a dictionary, so that nodes can be moved to a
+ * document read later by take_in_changes().
+ */
+static xmlDoc *
+read_config(const char *filename)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOG(LOG_ERROR, "no file (%s)", filename);
+		exit(EXIT_FAILURE);
+	}
+	struct stat st;
+	if (fstat(fd, &st) || st.st_size <= 0 || st.st_size > INT_MAX) {
+		close(fd);
+		return NULL;
+	}
+	char *data = malloc(st.st_size);
+	size_t len = 0;
+	while (len < (size_t)st.st_size) {
+		ssize_t ret = read(fd, data + len, st.st_size - len);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		len += ret;
+	}
+	close(fd);
+	xmlDoc *doc = NULL;
+	if (len) {
+		doc = xmlReadMemory(data, len, filename, NULL,
+			XML_PARSE_NODICT);
+	}
+	free(data);
+	if (doc) {
+		disk = st;
+	}
+	return doc;
+}
+
+/* The <regions> element of @doc, or NULL */
+static xmlNode *
+regions_element(xmlDoc *doc)
+{
+	xmlNode *root = xmlDocGetRootElement(doc);
+	if (!root || element_lookup(root->name) != ELEMENT_LABWC_CONFIG) {
+		return NULL;
+	}
+	for (xmlNode *n = root->children; n; n = n->next) {
+		if (n->type == XML_ELEMENT_NODE
+				&& element_lookup(n->name) == ELEMENT_REGIONS) {
+			return n;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * The config was written by something else since it was read or saved, so
+ * read it again and move the regions over into it, keeping whatever else
+ * changed there rather than writing over it
+ */
+static bool
+take_in_changes(const char *filename)
+{
+	xmlDoc *fresh = read_config(filename);
+	xmlNode *root = fresh ? xmlDocGetRootElement(fresh) : NULL;
+	xmlNode *ours = regions_element(doc);
+	if (!root || element_lookup(root->name) != ELEMENT_LABWC_CONFIG
+			|| !ours) {
+		LOG(LOG_ERROR, "config file changed and cannot be read, "
+			"not saving over it");
+		xmlFreeDoc(fresh);
+		return false;
+	}
+
+	xmlNode *theirs = regions_element(fresh);
+	xmlUnlinkNode(ours);
+	if (theirs) {
+		xmlReplaceNode(theirs, ours);
+		xmlFreeNode(theirs);
+	} else {
+		xmlAddChild(root, ours);
+	}
+	xmlFreeDoc(doc);
+	doc = fresh;
+	return true;
+}
+
+struct region_table *
 settings_init(const char *filename)
 {
-	wl_list_init(&regions);
+	region_table_init(&regions);
 
 	xmlKeepBlanksDefault(0);
-	xmlIndentTreeOutput = 1;
 
-	if (access(filename, F_OK)) {
-		LOG(LOG_ERROR, "no file (%s)", filename);
-		exit(EXIT_FAILURE);
-	}
-	doc = xmlReadFile(filename, NULL, 0);
+	doc = read_config(filename);
 	if (!doc) {
 		LOG(LOG_ERROR, "error parsing config file");
 		exit(EXIT_FAILURE);
 	}
-	xml_tree_walk(xmlDocGetRootElement(doc));
+	xml_tree_walk(xmlDocGetRootElement(doc), PATH_TOP);
 	return &regions;
 }
 
 void
 settings_finish(void)
 {
-	struct region *region, *next;
-	wl_list_for_each_safe(region, next, &regions, link) {
-		free(region->name);
-		wl_list_remove(&region->link);
-		free(region);
-	}
+	region_table_finish(&regions);
 	xmlFreeDoc(doc);
 	xmlCleanupParser();
 }
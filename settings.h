@@ -3,16 +3,61 @@
 #define SETTINGS_H
 #include "types.h"
 
+struct exporter;
+struct layout;
+struct preset_library;
+struct region_table;
+struct spatial_index;
 struct window;
 
 struct config {
 	char filename[4096];
-	struct wl_list *regions;
+	struct region_table *regions;
+	struct spatial_index *index;
+	struct layout *layout;
+	struct preset_library *presets;
+	/* Regions shared with labwc by a daemon, or NULL */
+	struct exporter *exporter;
+	/* Save edited geometry with up to four decimals rather than whole percent */
+	bool fractional_percent;
 };
 
-void convert_regions_from_percentage_to_pixels(struct window *window);
-struct wl_list *settings_init(const char *filename);
+/* Work out pixel geometry for an output of @width x @height pixels */
+void convert_regions_from_percentage_to_pixels(double width, double height);
+
+/*
+ * The output changed from @old_width x @old_height pixels to @width x
+ * @height. Work out the pixels anew from the fixed-point geometry, and scale
+ * edited ones along, leaving the fixed-point geometry to settings_save().
+ */
+void settings_rescale(double old_width, double old_height, double width,
+	double height);
+
+/*
+ * Scale all geometry by @scale on an output of @width x @height pixels,
+ * keeping each field in the unit it was read in
+ */
+void settings_scale(double scale, double width, double height);
+
+struct region_table *settings_init(const char *filename);
 void settings_finish(void);
-void settings_save(const struct state *state);
+
+/*
+ * Write the regions back to the config file, if they changed. If something
+ * else wrote the file since, its other settings are kept. Returns 1 if the
+ * file was written, 0 if nothing changed, and -1 if it could not be written,
+ * which is logged.
+ */
+int settings_save(const struct config *config, double width, double height);
+
+/*
+ * Add a region with a unique name to the table, and to the XML next to the
+ * element of region @after. Returns its id.
+ */
+int settings_region_add(int after);
+void settings_region_remove(int id);
+
+/* Rename region @id, unless another region is called @name already */
+bool settings_region_rename(int id, const char *name);
 
 #endif /* SETTINGS_H */
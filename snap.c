@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdlib.h>
+#include "region.h"
+#include "snap.h"
+
+static int
+compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Sort and drop duplicates, returning the new length */
+static int
+sort_unique(double *lines, int nr)
+{
+	qsort(lines, nr, sizeof(double), compare_double);
+	int n = 0;
+	for (int i = 0; i < nr; i++) {
+		if (!n || lines[i] != lines[n - 1]) {
+			lines[n++] = lines[i];
+		}
+	}
+	return n;
+}
+
+void
+snap_index_build(struct snap_index *snap, struct region_table *table,
+		int exclude, double width, double height)
+{
+	int capacity = 2 * table->nr + 2;
+	if (capacity > snap->capacity) {
+		snap->x = realloc(snap->x, capacity * sizeof(double));
+		snap->y = realloc(snap->y, capacity * sizeof(double));
+		snap->capacity = capacity;
+	}
+
+	/*
+	 * Straight over the columns, removed slots included. Their zero
+	 * geometry only repeats the output edges at 0, which sort_unique()
+	 * drops again.
+	 */
+	int nr = table->nr;
+	for (int i = 0; i < nr; i++) {
+		snap->x[2 * i] = table->x[i];
+		snap->x[2 * i + 1] = table->x[i] + table->width[i];
+		snap->y[2 * i] = table->y[i];
+		snap->y[2 * i + 1] = table->y[i] + table->height[i];
+	}
+	int n = 2 * nr;
+	if (exclude >= 0 && exclude < nr) {
+		/* Replaced by the output edges, which are needed anyway */
+		snap->x[2 * exclude] = 0;
+		snap->y[2 * exclude] = 0;
+		snap->x[2 * exclude + 1] = width;
+		snap->y[2 * exclude + 1] = height;
+	} else {
+		snap->x[n] = 0;
+		snap->y[n++] = 0;
+		snap->x[n] = width;
+		snap->y[n++] = height;
+	}
+	snap->nr_x = sort_unique(snap->x, n);
+	snap->nr_y = sort_unique(snap->y, n);
+}
+
+void
+snap_index_finish(struct snap_index *snap)
+{
+	free(snap->x);
+	free(snap->y);
+	*snap = (struct snap_index){ 0 };
+}
+
+/* Return the line nearest to @value, by binary search */
+static double
+nearest(const double *lines, int nr, double value)
+{
+	int low = 0, high = nr;
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+		if (lines[mid] < value) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	/* lines[low] is the first line >= value */
+	if (low == nr) {
+		return lines[nr - 1];
+	}
+	if (low > 0 && value - lines[low - 1] < lines[low] - value) {
+		return lines[low - 1];
+	}
+	return lines[low];
+}
+
+/* Return the offset that snaps the start or end of a span, or 0 */
+static double
+snap_span(const double *lines, int nr, double start, double size,
+		double threshold)
+{
+	if (!nr) {
+		return 0;
+	}
+	double to_start = nearest(lines, nr, start) - start;
+	double to_end = nearest(lines, nr, start + size) - (start + size);
+	double offset = fabs(to_start) <= fabs(to_end) ? to_start : to_end;
+	return fabs(offset) <= threshold ? offset : 0;
+}
+
+void
+snap_box(struct snap_index *snap, struct dbox *box, double threshold)
+{
+	box->x += snap_span(snap->x, snap->nr_x, box->x, box->width, threshold);
+	box->y += snap_span(snap->y, snap->nr_y, box->y, box->height, threshold);
+}
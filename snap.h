@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef SNAP_H
+#define SNAP_H
+#include "types.h"
+
+struct region_table;
+
+/*
+ * Sorted arrays of the vertical (x) and horizontal (y) lines a region can
+ * snap to, that is the edges of all other regions and of the output. Built
+ * once when a drag starts so that each motion event is a binary search.
+ */
+struct snap_index {
+	double *x, *y;
+	int nr_x, nr_y;
+	int capacity;
+};
+
+/* Collect the edges of the output and of every region but @exclude */
+void snap_index_build(struct snap_index *snap, struct region_table *table,
+	int exclude, double width, double height);
+void snap_index_finish(struct snap_index *snap);
+
+/*
+ * Move @box so that whichever of its edges is nearest to a snap line lies on
+ * it, independently for each axis. Edges further than @threshold pixels from
+ * every line leave that axis alone.
+ */
+void snap_box(struct snap_index *snap, struct dbox *box, double threshold);
+
+#endif /* SNAP_H */
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "region.h"
+#include "spatial.h"
+
+#define CELL_SIZE 128
+
+struct cell {
+	int *regions;
+	int nr_regions, capacity;
+};
+
+struct cell_range {
+	int x1, y1, x2, y2;
+};
+
+struct spatial_index {
+	struct region_table *table;
+	int columns, rows;
+	struct cell *cells;
+
+	/* Per region id, the cells it is listed in and its last query stamp */
+	struct cell_range *ranges;
+	unsigned int *stamps;
+	int capacity;
+
+	/* Bumped per query so that regions spanning cells are reported once */
+	unsigned int stamp;
+};
+
+struct spatial_index *
+spatial_index_create(struct region_table *table, int width, int height)
+{
+	struct spatial_index *index = calloc(1, sizeof(struct spatial_index));
+	index->table = table;
+	index->columns = width > 0 ? (width + CELL_SIZE - 1) / CELL_SIZE : 1;
+	index->rows = height > 0 ? (height + CELL_SIZE - 1) / CELL_SIZE : 1;
+	index->cells = calloc(index->columns * index->rows, sizeof(struct cell));
+	return index;
+}
+
+void
+spatial_index_destroy(struct spatial_index *index)
+{
+	if (!index) {
+		return;
+	}
+	for (int i = 0; i < index->columns * index->rows; i++) {
+		free(index->cells[i].regions);
+	}
+	free(index->cells);
+	free(index->ranges);
+	free(index->stamps);
+	free(index);
+}
+
+static int
+clamp(int value, int low, int high)
+{
+	return value < low ? low : value > high ? high : value;
+}
+
+static struct cell_range
+cell_range(struct spatial_index *index, const struct dbox *box)
+{
+	double x2 = box->x + (box->width > 0 ? box->width : 0);
+	double y2 = box->y + (box->height > 0 ? box->height : 0);
+	struct cell_range range = {
+		.x1 = clamp(floor(box->x / CELL_SIZE), 0, index->columns - 1),
+		.y1 = clamp(floor(box->y / CELL_SIZE), 0, index->rows - 1),
+		.x2 = clamp(floor(x2 / CELL_SIZE), 0, index->columns - 1),
+		.y2 = clamp(floor(y2 / CELL_SIZE), 0, index->rows - 1),
+	};
+	return range;
+}
+
+static bool
+range_contains(const struct cell_range *range, int x, int y)
+{
+	return x >= range->x1 && x <= range->x2
+		&& y >= range->y1 && y <= range->y2;
+}
+
+static struct cell *
+get_cell(struct spatial_index *index, int x, int y)
+{
+	return &index->cells[y * index->columns + x];
+}
+
+static void
+cell_add(struct cell *cell, int region)
+{
+	if (cell->nr_regions == cell->capacity) {
+		cell->capacity = cell->capacity ? cell->capacity * 2 : 8;
+		cell->regions = realloc(cell->regions,
+			cell->capacity * sizeof(int));
+	}
+	cell->regions[cell->nr_regions++] = region;
+}
+
+static void
+cell_remove(struct cell *cell, int region)
+{
+	for (int i = 0; i < cell->nr_regions; i++) {
+		if (cell->regions[i] == region) {
+			cell->regions[i] = cell->regions[--cell->nr_regions];
+			return;
+		}
+	}
+}
+
+static void
+reserve(struct spatial_index *index, int region)
+{
+	if (region < index->capacity) {
+		return;
+	}
+	int capacity = index->capacity ? index->capacity : 32;
+	while (capacity <= region) {
+		capacity *= 2;
+	}
+	index->ranges = realloc(index->ranges,
+		capacity * sizeof(struct cell_range));
+	index->stamps = realloc(index->stamps, capacity * sizeof(unsigned int));
+	memset(index->stamps + index->capacity, 0,
+		(capacity - index->capacity) * sizeof(unsigned int));
+	index->capacity = capacity;
+}
+
+void
+spatial_index_insert(struct spatial_index *index, int region)
+{
+	reserve(index, region);
+	struct dbox box = region_box(index->table, region);
+	struct cell_range range = cell_range(index, &box);
+	for (int y = range.y1; y <= range.y2; y++) {
+		for (int x = range.x1; x <= range.x2; x++) {
+			cell_add(get_cell(index, x, y), region);
+		}
+	}
+	index->ranges[region] = range;
+}
+
+void
+spatial_index_remove(struct spatial_index *index, int region)
+{
+	struct cell_range *range = &index->ranges[region];
+	for (int y = range->y1; y <= range->y2; y++) {
+		for (int x = range->x1; x <= range->x2; x++) {
+			cell_remove(get_cell(index, x, y), region);
+		}
+	}
+}
+
+void
+spatial_index_update(struct spatial_index *index, int region)
+{
+	struct cell_range old = index->ranges[region];
+	struct dbox box = region_box(index->table, region);
+	struct cell_range new = cell_range(index, &box);
+	if (!memcmp(&old, &new, sizeof(old))) {
+		return;
+	}
+
+	for (int y = old.y1; y <= old.y2; y++) {
+		for (int x = old.x1; x <= old.x2; x++) {
+			if (!range_contains(&new, x, y)) {
+				cell_remove(get_cell(index, x, y), region);
+			}
+		}
+	}
+	for (int y = new.y1; y <= new.y2; y++) {
+		for (int x = new.x1; x <= new.x2; x++) {
+			if (!range_contains(&old, x, y)) {
+				cell_add(get_cell(index, x, y), region);
+			}
+		}
+	}
+	index->ranges[region] = new;
+}
+
+static bool
+box_contains(const struct dbox *box, double x, double y)
+{
+	return x >= box->x && x < box->x + box->width
+		&& y >= box->y && y < box->y + box->height;
+}
+
+static bool
+boxes_intersect(const struct dbox *a, const struct dbox *b)
+{
+	return a->x < b->x + b->width && b->x < a->x + a->width
+		&& a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+/*
+ * Visit every region in the cells under @box once, reporting those for which
+ * @test is true
+ */
+static void
+query(struct spatial_index *index, const struct dbox *box,
+		bool (*test)(const struct dbox *region, const struct dbox *box),
+		int exclude, spatial_iter_fn fn, void *data)
+{
+	unsigned int stamp = ++index->stamp;
+	struct cell_range range = cell_range(index, box);
+	for (int y = range.y1; y <= range.y2; y++) {
+		for (int x = range.x1; x <= range.x2; x++) {
+			struct cell *cell = get_cell(index, x, y);
+			for (int i = 0; i < cell->nr_regions; i++) {
+				int region = cell->regions[i];
+				if (index->stamps[region] == stamp) {
+					continue;
+				}
+				index->stamps[region] = stamp;
+				struct dbox r = region_box(index->table, region);
+				if (region != exclude && test(&r, box)) {
+					fn(region, data);
+				}
+			}
+		}
+	}
+}
+
+static bool
+test_point(const struct dbox *region, const struct dbox *box)
+{
+	return box_contains(region, box->x, box->y);
+}
+
+void
+spatial_index_at(struct spatial_index *index, double x, double y,
+		spatial_iter_fn fn, void *data)
+{
+	struct dbox box = { x, y, 0, 0 };
+	query(index, &box, test_point, -1, fn, data);
+}
+
+void
+spatial_index_query(struct spatial_index *index, const struct dbox *box,
+		spatial_iter_fn fn, void *data)
+{
+	query(index, box, boxes_intersect, -1, fn, data);
+}
+
+void
+spatial_index_neighbors(struct spatial_index *index, int region,
+		double distance, spatial_iter_fn fn, void *data)
+{
+	/* Grown by a hair so that regions sharing an edge count at distance 0 */
+	distance += 0.5;
+	struct dbox r = region_box(index->table, region);
+	struct dbox box = {
+		.x = r.x - distance,
+		.y = r.y - distance,
+		.width = r.width + 2 * distance,
+		.height = r.height + 2 * distance,
+	};
+	query(index, &box, boxes_intersect, region, fn, data);
+}
+
+void
+spatial_index_overlaps(struct spatial_index *index, int region,
+		spatial_iter_fn fn, void *data)
+{
+	struct dbox r = region_box(index->table, region);
+	query(index, &r, boxes_intersect, region, fn, data);
+}
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef SPATIAL_H
+#define SPATIAL_H
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Uniform grid over region boxes in pixels. Each region is listed in every
+ * cell it covers, so queries only visit the cells under the query box rather
+ * than every region. Geometry outside the output is clamped to the border
+ * cells.
+ */
+struct region_table;
+struct spatial_index;
+
+typedef void (*spatial_iter_fn)(int region, void *data);
+
+struct spatial_index *spatial_index_create(struct region_table *table,
+	int width, int height);
+void spatial_index_destroy(struct spatial_index *index);
+
+void spatial_index_insert(struct spatial_index *index, int region);
+void spatial_index_remove(struct spatial_index *index, int region);
+
+/* Re-index @region after it moved, touching only cells that differ */
+void spatial_index_update(struct spatial_index *index, int region);
+
+/* Call @fn once for each region containing the point (@x, @y) */
+void spatial_index_at(struct spatial_index *index, double x, double y,
+	spatial_iter_fn fn, void *data);
+
+/* Call @fn once for each region intersecting @box */
+void spatial_index_query(struct spatial_index *index, const struct dbox *box,
+	spatial_iter_fn fn, void *data);
+
+/* Call @fn for each other region within @distance pixels of @region */
+void spatial_index_neighbors(struct spatial_index *index, int region,
+	double distance, spatial_iter_fn fn, void *data);
+
+/* Call @fn for each other region overlapping @region by a non-zero area */
+void spatial_index_overlaps(struct spatial_index *index, int region,
+	spatial_iter_fn fn, void *data);
+
+#endif /* SPATIAL_H */
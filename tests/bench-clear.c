@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Compare the ways of getting a buffer ready for the next frame: the full
+ * output CAIRO_OPERATOR_SOURCE paint that draw() used to start with, a
+ * clear_buffer() of the whole buffer, and a clear_buffer() of the boxes
+ * that dragging one region repairs.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <cairo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "util.h"
+
+#define FRAMES 200
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *what, int width, int height, double seconds,
+		size_t bytes)
+{
+	printf("%4dx%-4d  %-14s %8.3f ms/frame %8.2f GB/s\n", width, height,
+		what, seconds * 1e3 / FRAMES, bytes * FRAMES / seconds / 1e9);
+}
+
+static void
+bench(int width, int height)
+{
+	struct pool_buffer buffer = {
+		.width = width,
+		.height = height,
+	};
+	buffer.surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+		width, height);
+	buffer.cairo = cairo_create(buffer.surface);
+	buffer.data = cairo_image_surface_get_data(buffer.surface);
+	size_t size = (size_t)width * height * 4;
+
+	double start = now();
+	for (int i = 0; i < FRAMES; i++) {
+		cairo_save(buffer.cairo);
+		cairo_set_operator(buffer.cairo, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_rgba(buffer.cairo, 0, 0, 0, 0);
+		cairo_paint(buffer.cairo);
+		cairo_restore(buffer.cairo);
+		cairo_surface_flush(buffer.surface);
+	}
+	report("cairo paint", width, height, now() - start, size);
+
+	struct box whole = { 0, 0, width, height };
+	start = now();
+	for (int i = 0; i < FRAMES; i++) {
+		clear_buffer(&buffer, &whole);
+	}
+	report("clear whole", width, height, now() - start, size);
+
+	/*
+	 * A 400x300 region dragged to a new place, which repairs the 64 pixel
+	 * cells it left and the ones it now covers
+	 */
+	struct box repair[] = {
+		{ 64, 64, 448, 384 },
+		{ 1024, 512, 448, 384 },
+	};
+	size_t repair_size = 2 * 448 * 384 * 4;
+	start = now();
+	for (int i = 0; i < FRAMES; i++) {
+		clear_buffer(&buffer, &repair[0]);
+		clear_buffer(&buffer, &repair[1]);
+	}
+	report("clear repair", width, height, now() - start, repair_size);
+
+	cairo_destroy(buffer.cairo);
+	cairo_surface_destroy(buffer.surface);
+}
+
+int
+main(int argc, char *argv[])
+{
+	bench(1920, 1080);
+	bench(2560, 1440);
+	bench(3840, 2160);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* File sealing is a Linux extension */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "export.h"
+#include "test.h"
+
+/* Map @fd the way a reader would, or return NULL */
+static const struct export_header *
+map(int fd, size_t *size)
+{
+	struct stat st;
+	if (fstat(fd, &st)) {
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+	*size = st.st_size;
+	return data;
+}
+
+static const struct export_region *
+regions_of(const struct export_header *header)
+{
+	return (const void *)((const char *)header + header->header_size);
+}
+
+static void
+setup(int nr)
+{
+	region_table_init(&table);
+	for (int i = 0; i < nr; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "r%d", i);
+		add(name, i * 10, 5, 10, 20);
+	}
+}
+
+static void
+test_format(void)
+{
+	setup(3);
+	struct exporter *exporter = exporter_create();
+	expect(exporter);
+	int fd = exporter_fd(exporter);
+
+	/* Sealed against resizing and against more writers */
+	int seals = fcntl(fd, F_GET_SEALS);
+	expect(seals >= 0);
+	expect(seals & F_SEAL_SHRINK);
+	expect(seals & F_SEAL_GROW);
+	expect(seals & F_SEAL_SEAL);
+#ifdef F_SEAL_FUTURE_WRITE
+	expect(seals & F_SEAL_FUTURE_WRITE);
+#endif
+
+	size_t size;
+	const struct export_header *header = map(fd, &size);
+	expect(header);
+	expect(!memcmp(header->magic, EXPORT_MAGIC, sizeof(header->magic)));
+	expect(header->version == EXPORT_VERSION);
+	expect(header->header_size == sizeof(struct export_header));
+	expect(header->region_size == sizeof(struct export_region));
+	expect(header->capacity == EXPORT_CAPACITY);
+	expect(size >= header->header_size
+		+ header->capacity * header->region_size);
+
+	exporter_publish(exporter, &table, 1920, 1080);
+	uint32_t sequence = header->sequence;
+	expect(sequence > 0 && !(sequence & 1));
+	expect(header->nr_regions == 3);
+	expect(header->output_width == 1920 && header->output_height == 1080);
+	expect(!header->flags);
+	const struct export_region *regions = regions_of(header);
+	expect(!strcmp(regions[1].name, "r1"));
+	expect(regions[1].x == 10 && regions[1].y == 5);
+	expect(regions[1].width == 10 && regions[1].height == 20);
+	expect(regions[1].fx == table.fx[1] && regions[1].fy == table.fy[1]);
+
+	/* The same table again leaves the sequence alone */
+	exporter_publish(exporter, &table, 1920, 1080);
+	expect(header->sequence == sequence);
+
+	/* A changed one moves it on, and it stays even */
+	table.x[2] = 42;
+	exporter_publish(exporter, &table, 1920, 1080);
+	expect(header->sequence > sequence && !(header->sequence & 1));
+	expect(regions[2].x == 42);
+	sequence = header->sequence;
+
+	/* As does a removal or a new output size */
+	region_remove(&table, 0);
+	exporter_publish(exporter, &table, 1920, 1080);
+	expect(header->sequence > sequence && !(header->sequence & 1));
+	expect(header->nr_regions == 2);
+	expect(!strcmp(regions[0].name, "r1"));
+	sequence = header->sequence;
+	exporter_publish(exporter, &table, 2560, 1440);
+	expect(header->sequence > sequence && !(header->sequence & 1));
+
+	munmap((void *)header, size);
+	exporter_destroy(exporter);
+	region_table_finish(&table);
+}
+
+static void
+test_grow(void)
+{
+	int nr = EXPORT_CAPACITY + 1;
+	setup(nr);
+	struct exporter *exporter = exporter_create();
+	expect(exporter);
+
+	/* A reader holding the first export, as passed on by the daemon */
+	int old_fd = dup(exporter_fd(exporter));
+	size_t old_size;
+	const struct export_header *old = map(old_fd, &old_size);
+	expect(old);
+
+	exporter_publish(exporter, &table, 1920, 1080);
+	expect(old->flags & EXPORT_REPLACED);
+	expect(!(old->sequence & 1));
+
+	int fd = exporter_fd(exporter);
+	size_t size;
+	const struct export_header *header = map(fd, &size);
+	expect(header);
+	expect(header->capacity >= (uint32_t)nr);
+	expect(size >= header->header_size
+		+ header->capacity * header->region_size);
+	expect(fcntl(fd, F_GET_SEALS) & F_SEAL_GROW);
+	expect(header->nr_regions == (uint32_t)nr);
+	expect(!header->flags);
+	const struct export_region *regions = regions_of(header);
+	expect(!strcmp(regions[0].name, "r0"));
+	expect(!strcmp(regions[nr - 1].name, "r256"));
+	expect(regions[nr - 1].x == (nr - 1) * 10);
+
+	munmap((void *)header, size);
+	munmap((void *)old, old_size);
+	close(old_fd);
+	exporter_destroy(exporter);
+	region_table_finish(&table);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_format();
+	test_grow();
+	return test_status();
+}
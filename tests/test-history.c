@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "history.h"
+#include "test.h"
+
+static void
+setup(int nr)
+{
+	region_table_init(&table);
+	for (int i = 0; i < nr; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "r%d", i);
+		add(name, i * 10, 0, 10, 10);
+	}
+}
+
+static void
+test_undo_redo(void)
+{
+	setup(3);
+	struct history *history = history_create(&table, changed, NULL);
+	expect(!history_undo(history));
+	expect(!history_redo(history));
+
+	/* One gesture, touching a region more than once */
+	table.x[0] = 15;
+	history_touch(history, 0);
+	table.x[0] = 25.5;
+	history_touch(history, 0);
+	table.width[1] = -4.25;
+	history_touch(history, 1);
+	history_commit(history);
+
+	table.y[2] = 7.5;
+	history_touch(history, 2);
+	history_commit(history);
+
+	nr_changed = 0;
+	expect(history_undo(history));
+	expect(nr_changed == 1);
+	expect(box_is(2, 20, 0, 10, 10));
+	expect(box_is(0, 25.5, 0, 10, 10));
+
+	nr_changed = 0;
+	expect(history_undo(history));
+	expect(nr_changed == 2);
+	expect(box_is(0, 0, 0, 10, 10));
+	expect(box_is(1, 10, 0, 10, 10));
+	expect(!history_undo(history));
+
+	expect(history_redo(history));
+	expect(box_is(0, 25.5, 0, 10, 10));
+	expect(box_is(1, 10, 0, -4.25, 10));
+	expect(history_redo(history));
+	expect(box_is(2, 20, 7.5, 10, 10));
+	expect(!history_redo(history));
+
+	/* A new gesture drops what could have been redone */
+	expect(history_undo(history));
+	table.height[0] = 20;
+	history_touch(history, 0);
+	history_commit(history);
+	expect(!history_redo(history));
+
+	/* Nothing to undo after a reset */
+	history_reset(history);
+	expect(!history_undo(history));
+
+	history_destroy(history);
+	region_table_finish(&table);
+}
+
+/* Values that a delta in 1/FIXED_ONE pixels cannot restore exactly */
+static void
+test_exact(void)
+{
+	setup(200);
+	struct history *history = history_create(&table, NULL, NULL);
+	const double values[] = {
+		1.0 / 3, -2.0 / 3, 1e-9, 1e15, -1e300, 0.1 + 0.2,
+	};
+	int nr = sizeof(values) / sizeof(values[0]);
+
+	/* Ids of more than one varint byte too */
+	for (int i = 0; i < nr; i++) {
+		int id = 199 - i;
+		table.x[id] = values[i];
+		table.height[id] = values[i] * 2;
+		history_touch(history, id);
+	}
+	history_commit(history);
+
+	expect(history_undo(history));
+	for (int i = 0; i < nr; i++) {
+		expect(box_is(199 - i, (199 - i) * 10, 0, 10, 10));
+	}
+	expect(history_redo(history));
+	for (int i = 0; i < nr; i++) {
+		int id = 199 - i;
+		expect(table.x[id] == values[i]);
+		expect(table.height[id] == values[i] * 2);
+	}
+
+	history_destroy(history);
+	region_table_finish(&table);
+}
+
+/* The journal is bounded, so the oldest gestures are dropped */
+static void
+test_bounded(void)
+{
+	setup(3);
+	struct history *history = history_create(&table, NULL, NULL);
+	const int nr_gestures = 200000;
+	for (int i = 0; i < nr_gestures; i++) {
+		table.x[i % 3] += 1;
+		history_touch(history, i % 3);
+		history_commit(history);
+	}
+
+	int undone = 0;
+	while (history_undo(history)) {
+		undone++;
+	}
+	expect(undone > 0 && undone < nr_gestures);
+
+	/* Back to just before the oldest gesture kept */
+	double total = 0;
+	for (int i = 0; i < 3; i++) {
+		total += table.x[i] - i * 10;
+	}
+	expect(total == nr_gestures - undone);
+
+	history_destroy(history);
+	region_table_finish(&table);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_undo_redo();
+	test_exact();
+	test_bounded();
+	return test_status();
+}
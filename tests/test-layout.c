@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "layout.h"
+#include "test.h"
+
+static void
+test_split_merge(void)
+{
+	region_table_init(&table);
+	int left = add("left", 0, 0, 960, 1080);
+	int right = add("right", 960, 0, 960, 1080);
+	struct layout *layout = layout_create(&table, 1920, 1080, changed,
+		NULL);
+	expect(layout_has_region(layout, left));
+	expect(layout_has_region(layout, right));
+
+	/* The new region gets the bottom half */
+	int new = add("new", 0, 0, 0, 0);
+	expect(!layout_has_region(layout, new));
+	nr_changed = 0;
+	layout_split(layout, right, LAYOUT_SPLIT_V, new);
+	expect(layout_has_region(layout, new));
+	expect(box_is(right, 960, 0, 960, 540));
+	expect(box_is(new, 960, 540, 960, 540));
+	expect(box_is(left, 0, 0, 960, 1080));
+	expect(nr_changed == 2);
+
+	/* And side by side */
+	int third = add("third", 0, 0, 0, 0);
+	layout_split(layout, left, LAYOUT_SPLIT_H, third);
+	expect(box_is(left, 0, 0, 480, 1080));
+	expect(box_is(third, 480, 0, 480, 1080));
+
+	/* Merging gives the space back to the sibling */
+	expect(layout_merge(layout, new));
+	region_remove(&table, new);
+	expect(box_is(right, 960, 0, 960, 1080));
+	expect(layout_merge(layout, left));
+	region_remove(&table, left);
+	expect(box_is(third, 0, 0, 960, 1080));
+
+	/* Two regions left, each other's sibling */
+	expect(layout_merge(layout, third));
+	region_remove(&table, third);
+	expect(box_is(right, 0, 0, 1920, 1080));
+
+	/* The last region has nothing to merge into */
+	expect(!layout_merge(layout, right));
+	expect(box_is(right, 0, 0, 1920, 1080));
+
+	layout_destroy(layout);
+	region_table_finish(&table);
+}
+
+static void
+test_infer(void)
+{
+	region_table_init(&table);
+	/* A column on the left, and two stacked on the right */
+	int a = add("a", 0, 0, 640, 1080);
+	int b = add("b", 640, 0, 1280, 360);
+	int c = add("c", 640, 360, 1280, 720);
+	struct layout *layout = layout_create(&table, 1920, 1080, NULL, NULL);
+
+	/* c takes all of the right column, a is left alone */
+	expect(layout_merge(layout, b));
+	region_remove(&table, b);
+	expect(box_is(c, 640, 0, 1280, 1080));
+	expect(box_is(a, 0, 0, 640, 1080));
+
+	/* Splitting keeps to the region's own box */
+	int d = add("d", 0, 0, 0, 0);
+	layout_split(layout, c, LAYOUT_SPLIT_H, d);
+	expect(box_is(c, 640, 0, 640, 1080));
+	expect(box_is(d, 1280, 0, 640, 1080));
+
+	layout_destroy(layout);
+	region_table_finish(&table);
+}
+
+static void
+test_overlapping(void)
+{
+	region_table_init(&table);
+	/* No guillotine cut separates these, so each is a tree of its own */
+	int a = add("a", 0, 0, 600, 600);
+	int b = add("b", 300, 300, 600, 600);
+	struct layout *layout = layout_create(&table, 1920, 1080, NULL, NULL);
+	expect(layout_has_region(layout, a));
+	expect(layout_has_region(layout, b));
+	expect(!layout_merge(layout, a));
+	expect(box_is(a, 0, 0, 600, 600));
+	expect(box_is(b, 300, 300, 600, 600));
+
+	/* A lone region still splits within its own box */
+	int c = add("c", 0, 0, 0, 0);
+	layout_split(layout, a, LAYOUT_SPLIT_V, c);
+	expect(box_is(a, 0, 0, 600, 300));
+	expect(box_is(c, 0, 300, 600, 300));
+
+	layout_destroy(layout);
+	region_table_finish(&table);
+}
+
+int
+main(int argc, char *argv[])
+{
+	test_split_merge();
+	test_infer();
+	test_overlapping();
+	return test_status();
+}
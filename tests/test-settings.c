@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "region.h"
+#include "settings.h"
+#include "test.h"
+
+static const char rc[] =
+	"<?xml version=\"1.0\"?>\n"
+	"<labwc_config>\n"
+	"  <theme>\n"
+	"    <name>Default</name>\n"
+	"  </theme>\n"
+	"  <regions>\n"
+	"    <region name=\"top\" x=\"0%\" y=\"0%\" width=\"100%\" "
+	"height=\"33.3333%\"/>\n"
+	"    <region name=\"pixels\" x=\"10\" y=\"400\" width=\"300.5\" "
+	"height=\"20%\"/>\n"
+	"    <region name=\"negative\" x=\"-12.25\" y=\"0.0001%\" "
+	"width=\"1.5%\" height=\"7\"/>\n"
+	"  </regions>\n"
+	"</labwc_config>\n";
+
+static struct config config;
+
+static void
+write_file(const char *contents)
+{
+	FILE *f = fopen(config.filename, "w");
+	fputs(contents, f);
+	fclose(f);
+}
+
+static char *
+read_file(void)
+{
+	static char buf[4096];
+	FILE *f = fopen(config.filename, "r");
+	size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = '\0';
+	return buf;
+}
+
+static bool
+has(const char *needle)
+{
+	return strstr(read_file(), needle);
+}
+
+static void
+test_unchanged(void)
+{
+	write_file(rc);
+	settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+
+	/* Nothing changed, so nothing is written */
+	expect(settings_save(&config, 1920, 1080) == 0);
+	expect(!strcmp(read_file(), rc));
+
+	/* Nor after resizing back and forth */
+	for (int i = 0; i < 100; i++) {
+		settings_rescale(1920, 1080, 2560, 1443);
+		settings_rescale(2560, 1443, 1920, 1080);
+	}
+	expect(settings_save(&config, 1920, 1080) == 0);
+	settings_finish();
+}
+
+static void
+test_edit(void)
+{
+	write_file(rc);
+	struct region_table *regions = settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+	int top = region_find(regions, "top");
+	int pixels = region_find(regions, "pixels");
+	expect(top >= 0 && pixels >= 0);
+	expect(regions->x[pixels] == 10 && regions->width[pixels] == 300.5);
+	expect(regions->x[top] == 0 && regions->width[top] == 1920);
+
+	/* Edited fields are saved as percentages, the rest as they were */
+	regions->x[pixels] = 192;
+	regions->height[top] = 540;
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("name=\"top\" x=\"0%\" y=\"0%\" width=\"100%\" "
+		"height=\"50%\""));
+	expect(has("name=\"pixels\" x=\"10%\" y=\"400\" width=\"300.5\" "
+		"height=\"20%\""));
+	expect(has("name=\"negative\" x=\"-12.25\" y=\"0.0001%\" "
+		"width=\"1.5%\" height=\"7\""));
+	expect(has("<theme>"));
+
+	/* Saved once, so not again */
+	expect(settings_save(&config, 1920, 1080) == 0);
+
+	/* Renames, additions and removals are saved too */
+	expect(settings_region_rename(top, "upper"));
+	expect(!settings_region_rename(pixels, "upper"));
+	int added = settings_region_add(pixels);
+	regions->width[added] = 960;
+	regions->height[added] = 108;
+	settings_region_remove(region_find(regions, "negative"));
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("name=\"upper\""));
+	expect(has("name=\"region-1\""));
+	expect(has("width=\"50%\" height=\"10%\""));
+	expect(!has("negative"));
+	settings_finish();
+
+	/* And read back as saved */
+	regions = settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+	int upper = region_find(regions, "upper");
+	expect(upper >= 0 && regions->height[upper] == 540);
+	expect(region_find(regions, "top") < 0);
+	expect(region_find(regions, "region-1") >= 0);
+	expect(region_find(regions, "negative") < 0);
+	settings_finish();
+}
+
+static void
+test_fractional(void)
+{
+	write_file(rc);
+	config.fractional_percent = true;
+	struct region_table *regions = settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+	regions->width[region_find(regions, "top")] = 1000;
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("width=\"52.0833%\""));
+	config.fractional_percent = false;
+	settings_finish();
+}
+
+static void
+test_scale(void)
+{
+	write_file(rc);
+	settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+
+	/* Each field keeps its unit */
+	settings_scale(0.5, 1920, 1080);
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("name=\"top\" x=\"0%\" y=\"0%\" width=\"50%\" "
+		"height=\"16.6667%\""));
+	expect(has("name=\"pixels\" x=\"5\" y=\"200\" width=\"150.25\" "
+		"height=\"10%\""));
+	settings_finish();
+}
+
+static void
+test_no_drift(void)
+{
+	write_file(rc);
+	settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+	settings_save(&config, 1920, 1080);
+	settings_finish();
+
+	/* Loading and saving over and over gives back the same file */
+	for (int i = 0; i < 100; i++) {
+		settings_init(config.filename);
+		convert_regions_from_percentage_to_pixels(1920, 1080);
+		settings_save(&config, 1920, 1080);
+		settings_finish();
+	}
+	expect(!strcmp(read_file(), rc));
+}
+
+static void
+test_changed_on_disk(void)
+{
+	write_file(rc);
+	struct region_table *regions = settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+
+	/*
+	 * Written by something else meanwhile, which is kept. The size stays
+	 * the same and the write may land within the same mtime tick, so the
+	 * mtime is moved on by hand.
+	 */
+	char changed[sizeof(rc)];
+	snprintf(changed, sizeof(changed), "%s", rc);
+	char *name = strstr(changed, "Default");
+	memcpy(name, "Changed", strlen("Changed"));
+	write_file(changed);
+	struct timespec times[2] = {
+		{ .tv_nsec = UTIME_OMIT },
+		{ .tv_sec = 1 },
+	};
+	expect(!utimensat(AT_FDCWD, config.filename, times, 0));
+
+	regions->x[region_find(regions, "pixels")] = 192;
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("<name>Changed</name>"));
+	expect(has("name=\"pixels\" x=\"10%\""));
+	settings_finish();
+}
+
+static void
+test_unwritable(void)
+{
+	write_file(rc);
+	struct region_table *regions = settings_init(config.filename);
+	convert_regions_from_percentage_to_pixels(1920, 1080);
+
+	/* A file that cannot be written is an error, not "unchanged" */
+	struct config elsewhere = config;
+	strcpy(elsewhere.filename, "/nonexistent/labwc-regions-test.xml");
+	regions->x[region_find(regions, "pixels")] = 192;
+	expect(settings_save(&elsewhere, 1920, 1080) < 0);
+	expect(!strcmp(read_file(), rc));
+
+	/* And the edit is still there to save */
+	expect(settings_save(&config, 1920, 1080) == 1);
+	expect(has("name=\"pixels\" x=\"10%\""));
+	settings_finish();
+}
+
+int
+main(int argc, char *argv[])
+{
+	strcpy(config.filename, "/tmp/labwc-regions-test-XXXXXX");
+	int fd = mkstemp(config.filename);
+	if (fd < 0) {
+		perror("mkstemp");
+		return EXIT_FAILURE;
+	}
+	close(fd);
+
+	test_unchanged();
+	test_edit();
+	test_fractional();
+	test_scale();
+	test_no_drift();
+	test_changed_on_disk();
+	test_unwritable();
+
+	unlink(config.filename);
+	return test_status();
+}
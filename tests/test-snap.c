@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#define _POSIX_C_SOURCE 200809L
+#include "snap.h"
+#include "test.h"
+
+static void
+test_lines(void)
+{
+	struct snap_index snap = { 0 };
+	add("left", 0, 0, 500, 1080);
+	int right = add("right", 500, 0, 1420, 540);
+	add("bottom", 500, 540, 1420, 540);
+
+	snap_index_build(&snap, &table, -1, 1920, 1080);
+	/* Sorted, without the duplicates at 0, 500 and 1920 */
+	expect(snap.nr_x == 3);
+	expect(snap.x[0] == 0 && snap.x[1] == 500 && snap.x[2] == 1920);
+	expect(snap.nr_y == 3);
+	expect(snap.y[0] == 0 && snap.y[1] == 540 && snap.y[2] == 1080);
+
+	/* The dragged region's own edges are not snapped to */
+	region_set_box(&table, right, &(struct dbox){ 700, 100, 300, 300 });
+	snap_index_build(&snap, &table, right, 1920, 1080);
+	expect(snap.nr_x == 3);
+	expect(snap.nr_y == 3);
+	for (int i = 0; i < snap.nr_x; i++) {
+		expect(snap.x[i] != 700 && snap.x[i] != 1000);
+	}
+	region_set_box(&table, right, &(struct dbox){ 500, 0, 1420, 540 });
+	snap_index_finish(&snap);
+}
+
+static void
+test_snap_box(void)
+{
+	struct snap_index snap = { 0 };
+	int dragged = add("dragged", 0, 0, 0, 0);
+	snap_index_build(&snap, &table, dragged, 1920, 1080);
+
+	/* The left edge is within reach of x=500, the right edge of nothing */
+	struct dbox box = { 506, 300, 200, 100 };
+	snap_box(&snap, &box, 10);
+	expect(box.x == 500);
+	expect(box.y == 300);
+
+	/* The right and bottom edges snap to the output's */
+	box = (struct dbox){ 1715, 975, 200, 100 };
+	snap_box(&snap, &box, 10);
+	expect(box.x == 1720);
+	expect(box.y == 980);
+
+	/* Out of reach, so left alone */
+	box = (struct dbox){ 800, 300, 200, 100 };
+	snap_box(&snap, &box, 10);
+	expect(box.x == 800);
+	expect(box.y == 300);
+
+	/* Just within the threshold, on either side */
+	box = (struct dbox){ 490, 530, 100, 100 };
+	snap_box(&snap, &box, 10);
+	expect(box.x == 500);
+	expect(box.y == 540);
+	snap_index_finish(&snap);
+}
+
+int
+main(int argc, char *argv[])
+{
+	region_table_init(&table);
+	test_lines();
+	test_snap_box();
+	region_table_finish(&table);
+	return test_status();
+}
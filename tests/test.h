@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef TEST_H
+#define TEST_H
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "region.h"
+
+/*
+ * Checks that report where they failed and carry on, so that one run shows
+ * every failure. Tests return test_status() from main().
+ */
+static int test_failures;
+
+#define expect(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, \
+			#condition); \
+		test_failures++; \
+	} \
+} while (0)
+
+static inline int
+test_status(void)
+{
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * The regions that add() appends to, and the number of calls to changed()
+ * for tests to compare against
+ */
+static struct region_table table;
+static int nr_changed;
+
+static inline void
+changed(int region, void *data)
+{
+	nr_changed++;
+}
+
+static inline int
+add(const char *name, double x, double y, double width, double height)
+{
+	int id = region_add(&table, name, NULL);
+	region_set_box(&table, id, &(struct dbox){ x, y, width, height });
+	return id;
+}
+
+static inline bool
+box_is(int id, double x, double y, double width, double height)
+{
+	return table.x[id] == x && table.y[id] == y
+		&& table.width[id] == width && table.height[id] == height;
+}
+
+#endif /* TEST_H */
@@ -2,8 +2,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 #include <stdbool.h>
+#include <stdint.h>
 #include <libxml/parser.h>
-#include <wayland-client.h>
 
 struct window;
 struct config;
@@ -20,21 +20,10 @@ struct dbox {
 	double height;
 };
 
-struct bbox {
-	bool x;
-	bool y;
-	bool width;
-	bool height;
-};
-
-struct region {
-	struct dbox dbox;
-	struct bbox ispercentage;
+/* Fixed-point with four decimals, so FIXED_ONE is 1.0 */
+#define FIXED_ONE 10000
 
-	char *name;
-
-	xmlNode *node;
-	struct wl_list link;
-};
+/* Told about a region whose geometry was changed by a layout or solver */
+typedef void (*region_changed_fn)(int region, void *data);
 
 #endif /* TYPES_H */
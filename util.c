@@ -111,6 +111,7 @@ const char *_swaylock_strip_path(const char *filepath) {
 struct loop_fd_event {
 	void (*callback)(int fd, short mask, void *data);
 	void *data;
+	bool removed;
 	struct wl_list link; // struct loop_fd_event::link
 };
 
@@ -159,7 +160,25 @@ void loop_destroy(struct loop *loop) {
 	free(loop);
 }
 
+// Free the fds removed since, keeping the others in order
+static void loop_purge_fds(struct loop *loop) {
+	int fd_index = 0, kept = 0;
+	struct loop_fd_event *event = NULL, *tmp_event = NULL;
+	wl_list_for_each_safe(event, tmp_event, &loop->fd_events, link) {
+		if (event->removed) {
+			wl_list_remove(&event->link);
+			free(event);
+		} else {
+			loop->fds[kept++] = loop->fds[fd_index];
+		}
+		++fd_index;
+	}
+	loop->fd_length = kept;
+}
+
 void loop_poll(struct loop *loop) {
+	loop_purge_fds(loop);
+
 	// Calculate next timer in ms
 	int ms = INT_MAX;
 	if (!wl_list_empty(&loop->timers)) {
@@ -184,21 +203,27 @@ void loop_poll(struct loop *loop) {
 		exit(1);
 	}
 
-	// Dispatch fds
+	// Dispatch fds. Callbacks may add and remove fds, so only those
+	// polled are looked at, and removed ones are only freed afterwards.
 	size_t fd_index = 0;
+	int fd_length = loop->fd_length;
 	struct loop_fd_event *event = NULL;
 	wl_list_for_each(event, &loop->fd_events, link) {
+		if (fd_index == (size_t)fd_length) {
+			break;
+		}
 		struct pollfd pfd = loop->fds[fd_index];
 
 		// Always send these events
 		unsigned events = pfd.events | POLLHUP | POLLERR;
 
-		if (pfd.revents & events) {
+		if (!event->removed && (pfd.revents & events)) {
 			event->callback(pfd.fd, pfd.revents, event->data);
 		}
 
 		++fd_index;
 	}
+	loop_purge_fds(loop);
 
 	// Dispatch timers
 	if (!wl_list_empty(&loop->timers)) {
@@ -273,15 +298,12 @@ struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 
 bool loop_remove_fd(struct loop *loop, int fd) {
 	size_t fd_index = 0;
-	struct loop_fd_event *event = NULL, *tmp_event = NULL;
-	wl_list_for_each_safe(event, tmp_event, &loop->fd_events, link) {
-		if (loop->fds[fd_index].fd == fd) {
-			wl_list_remove(&event->link);
-			free(event);
-
-			loop->fd_length--;
-			memmove(&loop->fds[fd_index], &loop->fds[fd_index + 1],
-					sizeof(struct pollfd) * (loop->fd_length - fd_index));
+	struct loop_fd_event *event = NULL;
+	wl_list_for_each(event, &loop->fd_events, link) {
+		if (!event->removed && loop->fds[fd_index].fd == fd) {
+			// Freed after dispatch, poll() skips negative fds
+			event->removed = true;
+			loop->fds[fd_index].fd = -1;
 			return true;
 		}
 		++fd_index;
@@ -386,9 +408,51 @@ void destroy_buffer(struct pool_buffer *buffer) {
 	if (buffer->data) {
 		munmap(buffer->data, buffer->size);
 	}
+	free(buffer->cells);
 	memset(buffer, 0, sizeof(struct pool_buffer));
 }
 
+/*
+ * Clear @box to transparent black. The buffer is ARGB8888 so this is a plain
+ * memset() per row, which libc already implements with the widest vector
+ * stores available. Full-width boxes are cleared in a single call.
+ */
+void
+clear_buffer(struct pool_buffer *buffer, const struct box *box)
+{
+	struct box b = *box;
+	if (b.x < 0) {
+		b.width += b.x;
+		b.x = 0;
+	}
+	if (b.y < 0) {
+		b.height += b.y;
+		b.y = 0;
+	}
+	if (b.x + b.width > (int)buffer->width) {
+		b.width = buffer->width - b.x;
+	}
+	if (b.y + b.height > (int)buffer->height) {
+		b.height = buffer->height - b.y;
+	}
+	if (box_empty(&b) || !buffer->data) {
+		return;
+	}
+
+	cairo_surface_flush(buffer->surface);
+	size_t stride = buffer->width * 4;
+	unsigned char *row = (unsigned char *)buffer->data + b.y * stride + b.x * 4;
+	if (b.x == 0 && b.width == (int)buffer->width) {
+		memset(row, 0, stride * b.height);
+	} else {
+		for (int i = 0; i < b.height; i++, row += stride) {
+			memset(row, 0, b.width * 4);
+		}
+	}
+	cairo_surface_mark_dirty_rectangle(buffer->surface, b.x, b.y,
+		b.width, b.height);
+}
+
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
 		struct pool_buffer pool[static 2], uint32_t width, uint32_t height) {
 	struct pool_buffer *buffer = NULL;
@@ -418,6 +482,34 @@ struct pool_buffer *get_next_buffer(struct wl_shm *shm,
 	return buffer;
 }
 
+bool
+box_empty(const struct box *box)
+{
+	return box->width <= 0 || box->height <= 0;
+}
+
+void
+box_union(struct box *dst, const struct box *src)
+{
+	if (box_empty(src)) {
+		return;
+	}
+	if (box_empty(dst)) {
+		*dst = *src;
+		return;
+	}
+	int x1 = dst->x < src->x ? dst->x : src->x;
+	int y1 = dst->y < src->y ? dst->y : src->y;
+	int x2 = dst->x + dst->width > src->x + src->width ?
+		dst->x + dst->width : src->x + src->width;
+	int y2 = dst->y + dst->height > src->y + src->height ?
+		dst->y + dst->height : src->y + src->height;
+	dst->x = x1;
+	dst->y = y1;
+	dst->width = x2 - x1;
+	dst->height = y2 - y1;
+}
+
 uint32_t
 parse_color(const char *color)
 {
@@ -87,6 +87,22 @@ struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 bool loop_remove_fd(struct loop *loop, int fd);
 bool loop_remove_timer(struct loop *loop, struct loop_timer *timer);
 
+struct box {
+	int x, y, width, height;
+};
+
+bool box_empty(const struct box *box);
+void box_union(struct box *dst, const struct box *src);
+
+/* Most boxes damage is kept in, beyond which they are merged */
+#define DAMAGE_MAX_BOXES 32
+
+/* Disjoint boxes that changed */
+struct damage {
+	struct box boxes[DAMAGE_MAX_BOXES];
+	int nr;
+};
+
 struct pool_buffer {
 	struct wl_buffer *buffer;
 	cairo_surface_t *surface;
@@ -96,11 +112,17 @@ struct pool_buffer {
 	void *data;
 	size_t size;
 	bool busy;
+	/*
+	 * What the last frame rendered into this buffer drew in each of its
+	 * cells, kept by the renderer, or NULL before the first frame
+	 */
+	uint64_t *cells;
 };
 
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
 		struct pool_buffer pool[static 2], uint32_t width, uint32_t height);
 void destroy_buffer(struct pool_buffer *buffer);
+void clear_buffer(struct pool_buffer *buffer, const struct box *box);
 
 #define UTF8_MAX_SIZE 4
 #define UTF8_INVALID 0x80
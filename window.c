@@ -10,10 +10,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 #include <xkbcommon/xkbcommon.h>
+#include "atlas.h"
+#include "constraint.h"
+#include "export.h"
+#include "history.h"
+#include "layout.h"
 #include "microui.h"
+#include "preset.h"
+#include "region.h"
+#include "render.h"
 #include "settings.h"
+#include "snap.h"
+#include "spatial.h"
 #include "types.h"
 #include "util.h"
 #include "window.h"
@@ -21,131 +32,676 @@
 
 static mu_Context ctx;
 static PangoFontDescription *font_desc;
+static struct atlas *atlas;
+static struct renderer *renderer;
+static struct snap_index snap;
+static struct constraint_solver *solver;
+static struct history *history;
+
+/* Smallest width and height the constraint solver leaves neighbors */
+#define REGION_MIN_SIZE 16
+
+/* Split and merge requests, applied before the next frame is laid out */
+enum region_action {
+	REGION_ACTION_NONE,
+	REGION_ACTION_HSPLIT,
+	REGION_ACTION_VSPLIT,
+	REGION_ACTION_MERGE,
+	REGION_ACTION_PRESET,
+};
+
+static struct {
+	enum region_action action;
+	int region;
+	const char *preset;
+} pending = { .region = -1 };
+
+/* Key repeats after which arrow key nudges double, up to NUDGE_MAX_FACTOR */
+#define NUDGE_ACCEL_REPEATS 8
+#define NUDGE_MAX_FACTOR 8
+
+/*
+ * Arrow key nudges of the focused region, summed until the next frame is
+ * laid out, so that the region moves once per frame however fast keys repeat
+ */
+static struct {
+	double dx, dy, dwidth, dheight;
+	/* An arrow key is held, and what it nudged is one gesture */
+	bool held;
+	/* The key that started the gesture, whose release ends it */
+	uint32_t key;
+} nudge;
+
+/* The region whose window is on top, which arrow keys move */
+static int focused_region = -1;
+
+/*
+ * microui keeps its own copy of each window rectangle and only takes ours
+ * when the window is first shown, so pass on any geometry changed behind
+ * its back
+ */
+static void
+region_changed(int region, void *data)
+{
+	struct state *state = data;
+	struct region_table *regions = state->config->regions;
+	mu_Container *cnt = mu_get_container(&ctx, regions->name[region]);
+	cnt->rect = (mu_Rect){
+		.x = (int)round(regions->x[region]),
+		.y = (int)round(regions->y[region]),
+		.w = (int)round(regions->width[region]),
+		.h = (int)round(regions->height[region]),
+	};
+	spatial_index_update(state->config->index, region);
+	layout_refresh(state->config->layout, region);
+	history_touch(history, region);
+}
+
+/* (Re)build what is kept about the regions besides the table itself */
+static void
+index_regions(struct state *state)
+{
+	struct config *config = state->config;
+	struct surface *surface = state->window->surface;
+
+	spatial_index_destroy(config->index);
+	config->index = spatial_index_create(config->regions, surface->width,
+		surface->height);
+	region_for_each(config->regions, id) {
+		spatial_index_insert(config->index, id);
+	}
+	layout_destroy(config->layout);
+	config->layout = layout_create(config->regions, surface->width,
+		surface->height, region_changed, state);
+}
+
+static void
+apply_preset(struct state *state, const char *name)
+{
+	struct config *config = state->config;
+	struct surface *surface = state->window->surface;
+	if (!preset_apply(config->presets, name, config->regions,
+			surface->width, surface->height)) {
+		LOG(LOG_ERROR, "cannot apply preset '%s'", name);
+		return;
+	}
+	/* Every region may have moved, so start the indexes afresh */
+	index_regions(state);
+	region_for_each(config->regions, id) {
+		region_changed(id, state);
+	}
+}
+
+static void
+apply_pending_action(struct state *state)
+{
+	struct config *config = state->config;
+	int region = pending.region;
+	int new;
+
+	switch (pending.action) {
+	case REGION_ACTION_HSPLIT:
+	case REGION_ACTION_VSPLIT:
+		/* Add nothing that the layout would not take */
+		if (!layout_has_region(config->layout, region)) {
+			LOG(LOG_ERROR, "cannot split region '%s'",
+				config->regions->name[region]);
+			break;
+		}
+		new = settings_region_add(region);
+		spatial_index_insert(config->index, new);
+		layout_split(config->layout, region,
+			pending.action == REGION_ACTION_HSPLIT
+				? LAYOUT_SPLIT_H : LAYOUT_SPLIT_V, new);
+		break;
+	case REGION_ACTION_MERGE:
+		if (layout_merge(config->layout, region)) {
+			spatial_index_remove(config->index, region);
+			settings_region_remove(region);
+		}
+		break;
+	case REGION_ACTION_PRESET:
+		apply_preset(state, pending.preset);
+		break;
+	case REGION_ACTION_NONE:
+		break;
+	}
+	if (pending.action != REGION_ACTION_NONE) {
+		constraint_end(solver);
+		history_reset(history);
+	}
+	pending.action = REGION_ACTION_NONE;
+	pending.region = -1;
+	pending.preset = NULL;
+}
+
+/*
+ * microui moves a window by the raw pointer delta while its title bar is
+ * dragged. Track the unsnapped position separately, so that a snapped region
+ * can be pulled away again, and snap that to other regions and the output.
+ */
+static void
+snap_drag(struct state *state, int region, mu_Container *win)
+{
+	static int dragging = -1;
+	static struct dbox raw;
+
+	int threshold = state->window->snap_threshold;
+	bool dragged = threshold > 0 && ctx.mouse_down == MU_MOUSE_LEFT
+		&& ctx.focus == mu_get_id(&ctx, "!title", 6);
+	if (!dragged) {
+		if (dragging == region) {
+			dragging = -1;
+		}
+		return;
+	}
+
+	if (dragging != region) {
+		struct surface *surface = state->window->surface;
+		snap_index_build(&snap, state->config->regions, region,
+			surface->width, surface->height);
+		dragging = region;
+		raw = region_box(state->config->regions, region);
+	}
+	raw.x += ctx.mouse_delta.x;
+	raw.y += ctx.mouse_delta.y;
+
+	struct dbox box = {
+		.x = raw.x,
+		.y = raw.y,
+		.width = win->rect.w,
+		.height = win->rect.h,
+	};
+	snap_box(&snap, &box, threshold);
+	win->rect.x = (int)round(box.x);
+	win->rect.y = (int)round(box.y);
+}
+
+static void
+apply_nudge(struct state *state)
+{
+	int region = focused_region;
+	struct dbox delta = {
+		nudge.dx, nudge.dy, nudge.dwidth, nudge.dheight,
+	};
+	nudge.dx = nudge.dy = nudge.dwidth = nudge.dheight = 0;
+	if (region < 0 || (!delta.x && !delta.y && !delta.width
+			&& !delta.height)) {
+		return;
+	}
+	struct region_table *regions = state->config->regions;
+	struct dbox box = region_box(regions, region);
+	box.x += delta.x;
+	box.y += delta.y;
+	box.width += delta.width;
+	box.height += delta.height;
+
+	if (delta.width || delta.height) {
+		if (constraint_region(solver) != region) {
+			constraint_begin(solver, regions, region);
+		}
+		constraint_resize(solver, &box);
+	} else {
+		regions->x[region] = box.x;
+		regions->y[region] = box.y;
+		region_changed(region, state);
+	}
+}
+
+/* List the presets, any of which replaces the regions when clicked */
+static void
+presets_window(struct state *state)
+{
+	struct preset_library *presets = state->config->presets;
+	int nr = presets ? preset_count(presets) : 0;
+	mu_Rect rect = { 10, 10, 180, 40 + 24 * nr };
+	if (!nr) {
+		return;
+	}
+
+	/*
+	 * Region windows are found by the hash of their region's name, and
+	 * microui hashes this title on from the id pushed last. Starting with
+	 * a NUL byte, which no region name holds, keeps a region called
+	 * "presets" from sharing this window.
+	 */
+	mu_push_id(&ctx, "", 1);
+	if (!mu_begin_window_ex(&ctx, "presets", rect, MU_OPT_NOCLOSE)) {
+		mu_pop_id(&ctx);
+		return;
+	}
+	mu_layout_row(&ctx, 1, (int[]){ -1 }, 0);
+	for (int i = 0; i < nr; i++) {
+		const char *name = preset_name(presets, i);
+		if (mu_button(&ctx, name)) {
+			pending.action = REGION_ACTION_PRESET;
+			pending.preset = name;
+		}
+	}
+	mu_end_window(&ctx);
+	mu_pop_id(&ctx);
+}
+
+/* Higher windows looked at for each region, beyond which it is drawn anyway */
+#define MAX_OCCLUDERS 16
+
+/* Longest size label, as in "Size: -32768, -32768, 32768, 32768" */
+#define LABEL_SIZE 48
+
+/* What a frame keeps about each region window, by region id */
+struct region_view {
+	mu_Container *container;
+	/* Covered by higher windows or off the output, so not laid out */
+	bool hidden;
+	/* The size label, formatted only when @label_rect changes */
+	mu_Rect label_rect;
+	char label[LABEL_SIZE];
+};
+
+static struct {
+	struct region_view *views;
+	int capacity;
+} view_cache;
+
+static struct region_view *
+region_views(int nr)
+{
+	if (nr > view_cache.capacity) {
+		int capacity = view_cache.capacity ? view_cache.capacity : 16;
+		while (capacity < nr) {
+			capacity *= 2;
+		}
+		view_cache.views = realloc(view_cache.views,
+			capacity * sizeof(*view_cache.views));
+		for (int i = view_cache.capacity; i < capacity; i++) {
+			view_cache.views[i] = (struct region_view){
+				.label_rect.w = -1,
+			};
+		}
+		view_cache.capacity = capacity;
+	}
+	return view_cache.views;
+}
+
+struct occlusion {
+	struct region_view *views;
+	int zindex;
+	mu_Rect occluders[MAX_OCCLUDERS];
+	int nr_occluders;
+};
+
+static void
+add_occluder(int region, void *data)
+{
+	struct occlusion *occlusion = data;
+	mu_Container *cnt = occlusion->views[region].container;
+	if (cnt->zindex <= occlusion->zindex || !cnt->open
+			|| occlusion->nr_occluders == MAX_OCCLUDERS) {
+		return;
+	}
+	occlusion->occluders[occlusion->nr_occluders++] = cnt->rect;
+}
+
+static int
+compare_int(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+static int
+compare_rect_y(const void *a, const void *b)
+{
+	int x = ((const mu_Rect *)a)->y;
+	int y = ((const mu_Rect *)b)->y;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Whether the union of @occluders, of which there are at most MAX_OCCLUDERS,
+ * covers @rect. Their left and right edges cut @rect into slabs which each
+ * occluder either spans or misses, and every slab has to be covered from top
+ * to bottom by the occluders spanning it. That is at most 2 * @nr + 1 slabs,
+ * each a pass over the occluders sorted by their top edge.
+ */
+static bool
+rect_covered(mu_Rect rect, const mu_Rect *occluders, int nr)
+{
+	if (rect.w <= 0 || rect.h <= 0) {
+		return true;
+	}
+	int x2 = rect.x + rect.w;
+	int y2 = rect.y + rect.h;
+
+	/* The occluders clipped to @rect, and the edges where slabs begin */
+	mu_Rect clipped[MAX_OCCLUDERS];
+	int edges[2 * MAX_OCCLUDERS + 1];
+	int nr_clipped = 0;
+	int nr_edges = 0;
+	edges[nr_edges++] = rect.x;
+	for (int i = 0; i < nr; i++) {
+		const mu_Rect *o = &occluders[i];
+		int ox1 = mu_max(o->x, rect.x);
+		int oy1 = mu_max(o->y, rect.y);
+		int ox2 = mu_min(o->x + o->w, x2);
+		int oy2 = mu_min(o->y + o->h, y2);
+		if (ox1 >= ox2 || oy1 >= oy2) {
+			continue;
+		}
+		clipped[nr_clipped++] = mu_rect(ox1, oy1, ox2 - ox1, oy2 - oy1);
+		edges[nr_edges++] = ox1;
+		edges[nr_edges++] = ox2;
+	}
+	qsort(edges, nr_edges, sizeof(int), compare_int);
+	qsort(clipped, nr_clipped, sizeof(mu_Rect), compare_rect_y);
+
+	for (int i = 0; i < nr_edges; i++) {
+		int x = edges[i];
+		if (x == x2 || (i && x == edges[i - 1])) {
+			continue;
+		}
+		/* How far down the slab starting at @x is covered */
+		int covered = rect.y;
+		for (int j = 0; j < nr_clipped && covered < y2; j++) {
+			const mu_Rect *c = &clipped[j];
+			if (c->x > x || c->x + c->w <= x) {
+				continue;
+			}
+			if (c->y > covered) {
+				return false;
+			}
+			covered = mu_max(covered, c->y + c->h);
+		}
+		if (covered < y2) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find the region windows that would not show: those off the output, and
+ * those that higher ones cover completely, border included. Their windows
+ * are left out of the frame, so they cost no layout and no draw commands.
+ *
+ * This goes by the window rectangles of the last frame, so it is skipped
+ * while a mouse button is down, as microui may yet move a window this frame
+ * after a region under it has been left out. The region that arrow keys move
+ * is never left out either.
+ */
+static struct region_view *
+cull_regions(struct state *state)
+{
+	struct region_table *regions = state->config->regions;
+	struct region_view *views = region_views(regions->nr);
+	region_for_each(regions, region) {
+		/* Also keeps the containers of hidden windows in the pool */
+		views[region].container = mu_get_container(&ctx,
+			regions->name[region]);
+		views[region].hidden = false;
+	}
+	if (ctx.mouse_down) {
+		return views;
+	}
+
+	struct surface *surface = state->window->surface;
+	mu_Rect output = mu_rect(0, 0, surface->width, surface->height);
+	region_for_each(regions, region) {
+		mu_Container *cnt = views[region].container;
+		if (!cnt->rect.w) {
+			/* Not shown yet, so microui has still to take our rect */
+			continue;
+		}
+		if (region == focused_region) {
+			/*
+			 * Still the last frame's. Nudged off the output, it has
+			 * to stay laid out to keep its focus and come back.
+			 */
+			continue;
+		}
+		mu_Rect rect = cnt->rect;
+		rect = mu_rect(rect.x - 1, rect.y - 1, rect.w + 2, rect.h + 2);
+		int x1 = mu_max(rect.x, output.x);
+		int y1 = mu_max(rect.y, output.y);
+		int x2 = mu_min(rect.x + rect.w, output.w);
+		int y2 = mu_min(rect.y + rect.h, output.h);
+		if (x1 >= x2 || y1 >= y2) {
+			views[region].hidden = true;
+			continue;
+		}
+
+		struct occlusion occlusion = {
+			.views = views,
+			.zindex = cnt->zindex,
+		};
+		struct dbox box = {
+			.x = x1,
+			.y = y1,
+			.width = x2 - x1,
+			.height = y2 - y1,
+		};
+		spatial_index_query(state->config->index, &box, add_occluder,
+			&occlusion);
+		views[region].hidden = rect_covered(
+			mu_rect(x1, y1, x2 - x1, y2 - y1),
+			occlusion.occluders, occlusion.nr_occluders);
+	}
+	return views;
+}
 
 static void
 update(struct state *state)
 {
-	static bool has_been_converted_from_percentage;
-	if (!has_been_converted_from_percentage) {
+	/* Output size the pixel geometry was worked out for */
+	static uint32_t converted_width, converted_height;
+	struct surface *surface = state->window->surface;
+	if (!converted_width) {
 		/*
 		 * update() is never called before the layer-surface is
 		 * configured, so at this point the surface has width/height
 		 * which is what we need to covert from percentages.
 		 */
-		convert_regions_from_percentage_to_pixels(state->window);
-		has_been_converted_from_percentage = true;
+		convert_regions_from_percentage_to_pixels(surface->width,
+			surface->height);
+
+		index_regions(state);
+		solver = constraint_solver_create(state->window->region_gap,
+			REGION_MIN_SIZE, region_changed, state);
+		history = history_create(state->config->regions,
+			region_changed, state);
+	} else if (surface->width != converted_width
+			|| surface->height != converted_height) {
+		/* Resized, or shown again on another output */
+		settings_rescale(converted_width, converted_height,
+			surface->width, surface->height);
+		index_regions(state);
+		region_for_each(state->config->regions, id) {
+			region_changed(id, state);
+		}
+		/* Undo would bring back geometry for the old size */
+		constraint_end(solver);
+		history_reset(history);
+	}
+	converted_width = surface->width;
+	converted_height = surface->height;
+	apply_pending_action(state);
+	if (!(ctx.mouse_down & MU_MOUSE_LEFT) && !nudge.held) {
+		/* A gesture lasts from button press or key press to release */
+		constraint_end(solver);
+		history_commit(history);
 	}
+	apply_nudge(state);
 
 	mu_begin(&ctx);
-	struct region *region;
-	wl_list_for_each(region, state->config->regions, link) {
+	struct region_table *regions = state->config->regions;
+	struct region_view *views = cull_regions(state);
+	int top = -1;
+	focused_region = -1;
+	region_for_each(regions, region) {
+		if (views[region].hidden) {
+			continue;
+		}
 		mu_Rect r = {
-			.x = (int)round(region->dbox.x),
-			.y = (int)round(region->dbox.y),
-			.w = (int)round(region->dbox.width),
-			.h = (int)round(region->dbox.height),
+			.x = (int)round(regions->x[region]),
+			.y = (int)round(regions->y[region]),
+			.w = (int)round(regions->width[region]),
+			.h = (int)round(regions->height[region]),
 		};
-		if (mu_begin_window(&ctx, region->name, r)) {
+		if (mu_begin_window(&ctx, regions->name[region], r)) {
 			mu_Container *win = mu_get_current_container(&ctx);
-
-			region->dbox.x = win->rect.x;
-			region->dbox.y = win->rect.y;
-			region->dbox.width = win->rect.w;
-			region->dbox.height = win->rect.h;
-
-			char buf[256] = { 0 };
-			snprintf(buf, sizeof(buf), "Size: %d, %d, %d, %d",
-				win->rect.x, win->rect.y, win->rect.w, win->rect.h);
-			mu_label(&ctx, buf);
-
-			/* TODO */
-//			if (mu_button(&ctx, "h-split")) {
-//				fprintf(stderr, "h-split\n");
-//			}
-//			if (mu_button(&ctx, "v-split")) {
-//				fprintf(stderr, "v-split\n");
-//			}
+			if (win->zindex > top) {
+				top = win->zindex;
+				focused_region = region;
+			}
+			snap_drag(state, region, win);
+
+			if (win->rect.w != r.w || win->rect.h != r.h) {
+				struct dbox box = {
+					.x = win->rect.x,
+					.y = win->rect.y,
+					.width = win->rect.w,
+					.height = win->rect.h,
+				};
+				if (constraint_region(solver) != region) {
+					constraint_begin(solver, regions,
+						region);
+				}
+				constraint_resize(solver, &box);
+			} else if (win->rect.x != r.x || win->rect.y != r.y) {
+				regions->x[region] = win->rect.x;
+				regions->y[region] = win->rect.y;
+				spatial_index_update(state->config->index, region);
+				history_touch(history, region);
+			}
+
+			struct region_view *view = &views[region];
+			if (memcmp(&view->label_rect, &win->rect,
+					sizeof(mu_Rect))) {
+				view->label_rect = win->rect;
+				snprintf(view->label, sizeof(view->label),
+					"Size: %d, %d, %d, %d", win->rect.x,
+					win->rect.y, win->rect.w, win->rect.h);
+			}
+			mu_label(&ctx, view->label);
+
+			/*
+			 * Splitting or merging changes the region table, so
+			 * leave that until we are done walking it
+			 */
+			if (mu_button(&ctx, "h-split")) {
+				pending.action = REGION_ACTION_HSPLIT;
+				pending.region = region;
+			}
+			if (mu_button(&ctx, "v-split")) {
+				pending.action = REGION_ACTION_VSPLIT;
+				pending.region = region;
+			}
+			if (mu_button(&ctx, "merge")) {
+				pending.action = REGION_ACTION_MERGE;
+				pending.region = region;
+			}
 			mu_end_window(&ctx);
 		}
 	}
+	presets_window(state);
 	mu_end(&ctx);
+
+	if (state->config->exporter) {
+		exporter_publish(state->config->exporter, regions,
+			surface->width, surface->height);
+	}
 }
 
-static void
-draw_rect(cairo_t *cr, mu_Rect *rect, mu_Color *color)
+static bool
+modifier_active(struct window *window, const char *name)
 {
-	cairo_save(cr);
-	cairo_set_source_rgba(cr, color->r / 255.f, color->g / 255.f,
-		color->b / 255.f, color->a / 255.f);
-	cairo_rectangle(cr, rect->x, rect->y, rect->w, rect->h);
-	cairo_fill(cr);
-	cairo_restore(cr);
+	struct xkb_state *state = window->seat->xkb.state;
+	return state && xkb_state_mod_name_is_active(state, name,
+		XKB_STATE_MODS_EFFECTIVE) > 0;
 }
 
-static void
-draw_text(cairo_t *cr, mu_Vec2 *pos, mu_Color *color, const char *str)
+/*
+ * Pixels an arrow key nudges by along an axis of @size pixels: 1, or 10 with
+ * Shift, or 1% of the output with Ctrl. Held keys speed up as they repeat.
+ */
+static double
+nudge_step(struct window *window, uint32_t size)
 {
-	PangoLayout *layout = pango_cairo_create_layout(cr);
-	pango_layout_set_text(layout, str, -1);
-	pango_layout_set_font_description(layout, font_desc);
-
-	cairo_save(cr);
-	cairo_set_source_rgba(cr, color->r / 255.f, color->g / 255.f,
-		color->b / 255.f, color->a / 255.f);
-
-	pango_cairo_update_layout (cr, layout);
+	double step = 1;
+	if (modifier_active(window, XKB_MOD_NAME_CTRL)) {
+		step = size / 100.0;
+	} else if (modifier_active(window, XKB_MOD_NAME_SHIFT)) {
+		step = 10;
+	}
+	int factor = 1;
+	for (int n = window->seat->repeat_count / NUDGE_ACCEL_REPEATS;
+			n > 0 && factor < NUDGE_MAX_FACTOR; n--) {
+		factor *= 2;
+	}
+	return step * factor;
+}
 
-	int width, height;
-	pango_layout_get_size (layout, &width, &height);
-	cairo_move_to (cr, pos->x, pos->y);
-	pango_cairo_show_layout (cr, layout);
+/* Arrow keys move the focused region, or with Alt resize it */
+static void
+nudge_add(struct window *window, xkb_keysym_t keysym)
+{
+	struct surface *surface = window->surface;
+	bool resize = modifier_active(window, XKB_MOD_NAME_ALT);
+	double *dx = resize ? &nudge.dwidth : &nudge.dx;
+	double *dy = resize ? &nudge.dheight : &nudge.dy;
 
-	cairo_restore(cr);
-	g_object_unref(layout);
+	switch (keysym) {
+	case XKB_KEY_Up:
+		*dy -= nudge_step(window, surface->height);
+		break;
+	case XKB_KEY_Down:
+		*dy += nudge_step(window, surface->height);
+		break;
+	case XKB_KEY_Left:
+		*dx -= nudge_step(window, surface->width);
+		break;
+	case XKB_KEY_Right:
+		*dx += nudge_step(window, surface->width);
+		break;
+	default:
+		return;
+	}
+	nudge.held = true;
 }
 
+/* Key override */
 static void
-draw(cairo_t *cr)
+handle_key(struct window *window, xkb_keysym_t keysym, uint32_t codepoint)
 {
-	/* Clear background */
-	cairo_save(cr);
-	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.0);
-	cairo_paint(cr);
-	cairo_restore(cr);
-
-	mu_Command *cmd = NULL;
-	while (mu_next_command(&ctx, &cmd)) {
-		switch (cmd->type) {
-		case MU_COMMAND_RECT:
-			draw_rect(cr, &cmd->rect.rect, &cmd->rect.color);
+	/* Not set up until the first frame has been laid out */
+	if (history && modifier_active(window, XKB_MOD_NAME_CTRL)) {
+		switch (keysym) {
+		case XKB_KEY_z:
+			history_undo(history);
 			break;
-		case MU_COMMAND_ICON:
-			draw_rect(cr, &cmd->icon.rect, &cmd->icon.color);
+		case XKB_KEY_Z:
+		case XKB_KEY_y:
+			history_redo(history);
 			break;
-		case MU_COMMAND_TEXT:
-			draw_text(cr, &cmd->text.pos, &cmd->text.color, cmd->text.str);
-			break;
-		case MU_COMMAND_CLIP:
-			/* fallthrough - who cares */
 		default:
 			break;
 		}
 	}
-}
 
-/* Key override */
-static void
-handle_key(struct window *window, xkb_keysym_t keysym, uint32_t codepoint)
-{
 	switch (keysym) {
 	case XKB_KEY_Up:
 	case XKB_KEY_Down:
 	case XKB_KEY_Right:
 	case XKB_KEY_Left:
+		nudge_add(window, keysym);
 		break;
 	case XKB_KEY_Escape:
-		window->run_display = false;
+		if (window->daemon) {
+			window_hide(window);
+		} else {
+			window->run_display = false;
+		}
 		break;
 	default:
 		break;
@@ -173,32 +729,81 @@ surface_is_configured(struct surface *surface)
 	return (surface->width && surface->height);
 }
 
-void
+static void
+render_done(struct pool_buffer *buffer, const struct damage *damage,
+		void *data)
+{
+	struct surface *surface = data;
+	if (!surface_is_configured(surface)) {
+		/* Hidden while the frame was drawn, so it is never attached */
+		buffer->busy = false;
+		return;
+	}
+
+	wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
+	if (surface->last_width != buffer->width
+			|| surface->last_height != buffer->height) {
+		wl_surface_damage_buffer(surface->surface, 0, 0,
+			INT32_MAX, INT32_MAX);
+		surface->last_width = buffer->width;
+		surface->last_height = buffer->height;
+	} else {
+		for (int i = 0; i < damage->nr; i++) {
+			const struct box *box = &damage->boxes[i];
+			wl_surface_damage_buffer(surface->surface, box->x,
+				box->y, box->width, box->height);
+		}
+	}
+	wl_surface_commit(surface->surface);
+	window_startup_mark(surface->window, "first frame");
+	surface->window->startup_profile = false;
+}
+
+/*
+ * Fonts are only needed once there is something to draw, so leave loading
+ * them until the surface is first configured rather than holding up the
+ * connection to the compositor
+ */
+static void
+renderer_init(struct window *window)
+{
+	font_desc = pango_font_description_from_string("Sans 10");
+	atlas = atlas_create(font_desc);
+	renderer = renderer_create(window->render_threads, atlas, font_desc);
+	renderer_start(renderer, window->eventloop, render_done,
+		window->surface);
+	window_startup_mark(window, "fonts loaded");
+}
+
+/*
+ * Lay out the next frame and hand it to the render thread, which reports
+ * back through render_done() for the attach and commit. Returns false if no
+ * frame could be started, for example because the previous one is still
+ * being drawn.
+ */
+static bool
 render_frame(struct surface *surface)
 {
 	struct window *window = surface->window;
 
 	if (!surface_is_configured(surface)) {
-		return;
+		return false;
+	}
+	if (!renderer) {
+		renderer_init(window);
+	}
+	if (renderer_busy(renderer)) {
+		return false;
 	}
 	struct pool_buffer *buffer = get_next_buffer(window->shm,
 		surface->buffers, surface->width, surface->height);
 	if (!buffer) {
-		return;
+		return false;
 	}
 
-	cairo_t *cairo = buffer->cairo;
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_identity_matrix(cairo);
-
 	update((struct state *)window->data);
-	draw(cairo);
-
-	cairo_surface_flush(buffer->surface);
-
-	wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
-	wl_surface_damage_buffer(surface->surface, 0, 0, INT32_MAX, INT32_MAX);
-	wl_surface_commit(surface->surface);
+	renderer_submit(renderer, &ctx, buffer);
+	return true;
 }
 
 static void
@@ -206,16 +811,30 @@ layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *layer_surface,
 		uint32_t serial, uint32_t width, uint32_t height)
 {
 	struct surface *surface = data;
+	if (!surface_is_configured(surface)) {
+		window_startup_mark(surface->window, "configured");
+	}
 	surface->width = width;
 	surface->height = height;
 	zwlr_layer_surface_v1_ack_configure(layer_surface, serial);
-	render_frame(surface);
+	if (!render_frame(surface)) {
+		surface_damage(surface);
+	}
 }
 
 static void
 layer_surface_closed(void *data, struct zwlr_layer_surface_v1 *layer_surface)
 {
 	struct surface *surface = data;
+	struct window *window = surface->window;
+	if (window->daemon) {
+		/* Keep the surface, and give it a new role on the next show */
+		window->visible = false;
+		zwlr_layer_surface_v1_destroy(surface->layer_surface);
+		surface->layer_surface = NULL;
+		surface->width = surface->height = 0;
+		return;
+	}
 	surface_destroy(surface);
 }
 
@@ -264,8 +883,17 @@ surface_frame_done(void *data, struct wl_callback *callback, uint32_t time)
 	struct wl_callback *_callback = wl_surface_frame(surface->surface);
 	wl_callback_add_listener(_callback, &surface_frame_listener, surface);
 	surface->frame_pending = true;
-	render_frame(surface);
-	surface->dirty = false;
+
+	/*
+	 * If the previous frame is still being drawn, stay dirty. Its commit
+	 * carries the frame callback requested above, so we get another go.
+	 */
+	if (render_frame(surface)) {
+		surface->dirty = false;
+	} else if (!renderer_busy(renderer)) {
+		/* No free buffer, try again on the next frame */
+		wl_surface_commit(surface->surface);
+	}
 }
 
 static const struct wl_callback_listener surface_frame_listener = {
@@ -329,6 +957,10 @@ handle_wl_output_name(void *data, struct wl_output *wl_output, const char *name)
 {
 	struct output *output = data;
 	output->name = strdup(name);
+	if (output->window->surface
+			&& output->window->surface->wl_output == wl_output) {
+		LOG(LOG_INFO, "using output '%s'", name);
+	}
 }
 
 static void
@@ -363,6 +995,9 @@ handle_wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
 		uint32_t format, int32_t fd, uint32_t size)
 {
 	struct seat *seat = data;
+	if (!seat->xkb.context) {
+		seat->xkb.context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	}
 	if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
 		close(fd);
 		LOG(LOG_ERROR, "unknown keymap format %d", format);
@@ -399,7 +1034,12 @@ static void
 handle_wl_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
 		uint32_t serial, struct wl_surface *surface)
 {
-	/* nop */
+	struct seat *seat = data;
+	if (nudge.held) {
+		/* The release of the arrow key will not reach us */
+		nudge.held = false;
+		surface_damage(seat->window->surface);
+	}
 }
 
 static void
@@ -409,6 +1049,7 @@ keyboard_repeat(void *data)
 	struct window *window = seat->window;
 	seat->repeat_timer = loop_add_timer(window->eventloop,
 		seat->repeat_period_ms, keyboard_repeat, seat);
+	seat->repeat_count++;
 	handle_key(window, seat->repeat_sym, seat->repeat_codepoint);
 }
 
@@ -422,8 +1063,17 @@ handle_wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
 	uint32_t keycode = key_state == WL_KEYBOARD_KEY_STATE_PRESSED ?  key + 8 : 0;
 	uint32_t codepoint = xkb_state_key_get_utf32(seat->xkb.state, keycode);
 	if (key_state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+		seat->repeat_count = 0;
+		bool held = nudge.held;
 		handle_key(seat->window, sym, keycode);
+		if (nudge.held && !held) {
+			nudge.key = key;
+		}
 		mu_input_keydown(&ctx, (int)keycode);
+	} else if (nudge.held && key == nudge.key) {
+		/* Let the next frame end the gesture */
+		nudge.held = false;
+		surface_damage(seat->window->surface);
 	}
 
 	if (seat->repeat_timer) {
@@ -478,8 +1128,10 @@ static void
 update_cursor(struct seat *seat, uint32_t serial)
 {
 	struct window *window = seat->window;
-	seat->cursor_theme =
-		wl_cursor_theme_load(getenv("XCURSOR_THEME"), 24, window->shm);
+	if (!seat->cursor_theme) {
+		seat->cursor_theme = wl_cursor_theme_load(
+			getenv("XCURSOR_THEME"), 24, window->shm);
+	}
 	struct wl_cursor *cursor =
 		wl_cursor_theme_get_cursor(seat->cursor_theme, "left_ptr");
 	struct wl_cursor_image *cursor_image = cursor->images[0];
@@ -744,6 +1396,11 @@ globals_init(struct window *window)
 static int
 text_width(mu_Font font, const char *str, int len)
 {
+	int atlas_width = atlas_text_width(atlas, str, len);
+	if (atlas_width >= 0) {
+		return atlas_width;
+	}
+
 	if (len == -1) {
 		len = strlen(str);
 	}
@@ -770,6 +1427,28 @@ text_height(mu_Font font)
 	return height;
 }
 
+static void
+display_in(int fd, short mask, void *data)
+{
+	struct window *window = (struct window *)data;
+	if (wl_display_dispatch(window->display) == -1) {
+		window->run_display = false;
+	}
+}
+
+void
+window_startup_mark(struct window *window, const char *what)
+{
+	if (!window->startup_profile) {
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double ms = (now.tv_sec - window->startup_time.tv_sec) * 1000.0
+		+ (now.tv_nsec - window->startup_time.tv_nsec) / 1e6;
+	fprintf(stderr, "%8.2f ms  %s\n", ms, what);
+}
+
 void
 window_init(struct window *window)
 {
@@ -777,15 +1456,15 @@ window_init(struct window *window)
 
 	window->display = wl_display_connect(NULL);
 	DIE_ON(!window->display, "unable to connect to compositor");
+	window_startup_mark(window, "connected");
 
+	/*
+	 * One roundtrip for the globals is all it takes. Output, seat and
+	 * keyboard details arrive along with the first configure, and are
+	 * handled as they come.
+	 */
 	globals_init(window);
-
-	window->seat->xkb.context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-
-	if (wl_display_roundtrip(window->display) < 0) {
-		LOG(LOG_ERROR, "wl_display_roundtrip()");
-		exit(EXIT_FAILURE);
-	}
+	window_startup_mark(window, "globals bound");
 
 	window->seat->cursor_surface = wl_compositor_create_surface(window->compositor);
 
@@ -798,33 +1477,68 @@ window_init(struct window *window)
 		window->surface->wl_output = output->wl_output;
 		break;
 	}
-	LOG(LOG_INFO, "using output '%s'", output->name);
 
-	/* TODO: add option to create xdg-shell */
-	surface_layer_surface_create(window->surface);
+	/* A daemon stays hidden until told to show */
+	window->visible = !window->daemon;
+	if (window->visible) {
+		/* TODO: add option to create xdg-shell */
+		surface_layer_surface_create(window->surface);
+	}
 
-	font_desc = pango_font_description_from_string("Sans 10");
 	mu_init(&ctx);
 	ctx.text_width = text_width;
 	ctx.text_height = text_height;
+
+	window->eventloop = loop_create();
+	loop_add_fd(window->eventloop, wl_display_get_fd(window->display),
+		    POLLIN, display_in, window);
 }
 
-static void
-display_in(int fd, short mask, void *data)
+void
+window_show(struct window *window)
 {
-	struct window *window = (struct window *)data;
-	if (wl_display_dispatch(window->display) == -1) {
-		window->run_display = false;
+	if (window->visible) {
+		return;
+	}
+	window->visible = true;
+
+	/*
+	 * Everything but the mapping is kept while hidden, so all it takes
+	 * is the initial commit that gets the surface configured again
+	 */
+	struct surface *surface = window->surface;
+	if (!surface->layer_surface) {
+		surface_layer_surface_create(surface);
+	} else {
+		wl_surface_commit(surface->surface);
 	}
 }
 
 void
-window_run(struct window *window)
+window_hide(struct window *window)
 {
-	window->eventloop = loop_create();
-	loop_add_fd(window->eventloop, wl_display_get_fd(window->display),
-		    POLLIN, display_in, window);
+	struct surface *surface = window->surface;
+	if (!window->visible) {
+		return;
+	}
+	window->visible = false;
+	if (surface_is_configured(surface) && window->hidden) {
+		window->hidden(window);
+	}
+
+	wl_surface_attach(surface->surface, NULL, 0, 0);
+	wl_surface_commit(surface->surface);
 
+	/* No frames until the next configure, which starts afresh */
+	surface->width = surface->height = 0;
+	surface->last_width = surface->last_height = 0;
+	surface->dirty = false;
+	surface->frame_pending = false;
+}
+
+void
+window_run(struct window *window)
+{
 	window->run_display = true;
 	while (window->run_display) {
 		errno = 0;
@@ -838,6 +1552,13 @@ window_run(struct window *window)
 void
 window_finish(struct window *window)
 {
+	/* Wait for the render thread before tearing down its buffers */
+	renderer_destroy(renderer);
+	mu_finish(&ctx);
+	free(view_cache.views);
+	snap_index_finish(&snap);
+	constraint_solver_destroy(solver);
+	history_destroy(history);
 	surface_destroy(window->surface);
 
 	struct output *output, *next;
@@ -869,6 +1590,8 @@ window_finish(struct window *window)
 	loop_remove_fd(window->eventloop, wl_display_get_fd(window->display));
 	loop_destroy(window->eventloop);
 
+	atlas_destroy(atlas);
+	pango_font_description_free(font_desc);
 	pango_cairo_font_map_set_default(NULL);
 
 	wl_compositor_destroy(window->compositor);
@@ -4,6 +4,7 @@
 #include <cairo.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 #include <wayland-client.h>
 #include <wayland-cursor.h>
 #include <xkbcommon/xkbcommon.h>
@@ -23,6 +24,25 @@ struct window {
 	struct wl_list outputs;
 	struct surface *surface;
 
+	/* Number of threads rasterizing each frame */
+	int render_threads;
+	/* Distance in pixels within which dragged regions snap to edges */
+	int snap_threshold;
+	/* Gap in pixels kept between neighbors when resizing regions */
+	int region_gap;
+
+	/*
+	 * A daemon starts hidden, and hides rather than exits on Escape,
+	 * calling @hidden first if the editor was shown
+	 */
+	bool daemon;
+	bool visible;
+	void (*hidden)(struct window *window);
+
+	/* Print how long startup takes, counting from @startup_time */
+	bool startup_profile;
+	struct timespec startup_time;
+
 	struct loop *eventloop;
 	struct loop_timer *hover_timer;
 	struct zwlr_layer_shell_v1 *layer_shell;
@@ -87,6 +107,8 @@ struct seat {
 	int32_t repeat_delay_ms;
 	uint32_t repeat_sym;
 	uint32_t repeat_codepoint;
+	/* Repeats of the key held down so far */
+	int repeat_count;
 	struct loop_timer *repeat_timer;
 };
 
@@ -99,12 +121,21 @@ struct surface {
 	struct pool_buffer buffers[2];
 	bool frame_pending, dirty;
 	uint32_t width, height;
+	/* Size of the last committed frame */
+	uint32_t last_width, last_height;
 	struct zwlr_layer_surface_v1 *layer_surface;
 };
 
 void surface_damage(struct surface *surface);
+
+/* With --startup-profile, print the time it took to get to @what */
+void window_startup_mark(struct window *window, const char *what);
 void window_init(struct window *window);
 void window_run(struct window *window);
+
+/* Map or unmap the editor, keeping everything else alive in between */
+void window_show(struct window *window);
+void window_hide(struct window *window);
 void window_finish(struct window *window);
 
 #endif /* WINDOW_H */